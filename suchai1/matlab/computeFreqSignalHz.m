@@ -1,8 +1,12 @@
-function freq = computeFreqSignalHz(adcValue, samplingCoeff)
+function freq = computeFreqSignalHz(adcValue, samplingCoeff, dTSampling)
+% dTSampling (optional): time between samples measured on board (fisTiming),
+% if not given it comes from the lab linear fit of payloadCSV.csv
 
-[m, n, ~, ~] = payloadLinearFit(pwd);
-dTSampling = m*adcValue + n;
+if nargin < 3 || isempty(dTSampling)
+    [m, n, ~, ~] = payloadLinearFit(pwd);
+    dTSampling = m*adcValue + n;
+end
 dTSignal = dTSampling * samplingCoeff;
 freq = 1 / dTSignal;
 
-end
\ No newline at end of file
+end
@@ -0,0 +1,53 @@
+function g = fisGeometry(words)
+% FISGEOMETRY decodes the expFis geometry records (fis_payload.h)
+%   g = FISGEOMETRY(words) finds the geometry records (id 0x6E03) in the
+%   vector of 16 bits words saved by pay_exec_expFis and returns a struct
+%   array, one element per run. The record follows the stats record of the
+%   run, so it is only saved with FIS_OUTPUT_STATS.
+%
+%   Fields: adcPeriod, seed, rounds, points, samplesPerPoint, buffLen, inb4,
+%   profile (0 = SUCHAI 2/3, 1 = SUCHAI 1), parkDac and roundSeed (profile
+%   flags). With roundSeed the Vin of round r is fisRng(seed + r, 0:points-1),
+%   otherwise it is fisRng(seed, r*points + (0:points-1)). reduce is what
+%   the raw data holds of each point: 0 = every sample, 1 = mean, 2 = median,
+%   3 = last sample (one value per point, see pairSamplesWithPoints).
+%   settle is the on-board transient rejection (0 = off, 4095 = automatic,
+%   with tolerance settleTol counts) and discarded the samples it dropped in
+%   the run; the points dropped from each buffer are given by fisSettle.
+%
+%   Logs of the SUCHAI 1 flight software have no geometry record, their
+%   geometry is points = 1000, samplesPerPoint = 4, buffLen = 200, inb4 = 0
+%   (rand() stimulus, not fisRng).
+
+ID = hex2dec('6E03');
+LEN = 14;
+
+words = double(words(:));
+g = struct('adcPeriod', {}, 'seed', {}, 'rounds', {}, 'points', {}, ...
+    'samplesPerPoint', {}, 'buffLen', {}, 'inb4', {}, 'profile', {}, ...
+    'parkDac', {}, 'roundSeed', {}, 'reduce', {}, 'settle', {}, ...
+    'settleTol', {}, 'discarded', {});
+p = 1;
+while p + LEN - 1 <= length(words)
+    if words(p) ~= ID || words(p+8) > 1
+        p = p + 1;
+        continue;
+    end
+    r.adcPeriod = words(p+1);
+    r.seed = words(p+2);
+    r.rounds = words(p+3);
+    r.points = words(p+4);
+    r.samplesPerPoint = words(p+5);
+    r.buffLen = words(p+6);
+    r.inb4 = words(p+7);
+    r.profile = words(p+8);
+    r.parkDac = bitand(words(p+9), 1) ~= 0;
+    r.roundSeed = bitand(words(p+9), 2) ~= 0;
+    r.reduce = words(p+10);
+    r.settle = mod(words(p+11), 2^12);
+    r.settleTol = floor(words(p+11) / 2^12);
+    r.discarded = words(p+12) + words(p+13) * 2^16;
+    g(end+1) = r; %#ok<AGROW>
+    p = p + LEN;
+end
+end
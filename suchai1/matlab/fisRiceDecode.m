@@ -0,0 +1,105 @@
+function [samples, nBlocks, skipped, starts] = fisRiceDecode(words)
+% FISRICEDECODE decodes the expFis compressed blocks (fis_comp.h)
+%   samples = FISRICEDECODE(words) returns the ADC samples coded in the
+%   vector of 16 bits words saved by pay_exec_expFis with FIS_OUTPUT_COMP.
+%   Each block is: (k<<12)|n, first sample, m, m words of Rice bitstream
+%   (MSB first). k = 15 means n raw samples follow the first word.
+%   Decoding stops at the first incomplete or malformed block, so words
+%   after a lost frame are not decoded.
+%   [samples, nBlocks] = FISRICEDECODE(words) also returns the number of
+%   decoded blocks.
+%
+%   With the on-board transient rejection on (pay_set_settle_expFis) each
+%   block is preceded by a mark word 0xD000 | points (k = 13 is never used by
+%   a block). [samples, nBlocks, skipped, starts] = FISRICEDECODE(words) also
+%   returns the points discarded at the beginning of each block (0 without a
+%   mark) and the index in samples of the first sample of each block, as
+%   fisSettle does for the raw data.
+
+RAW_K = 15;
+MARK_K = 13;
+ESC_Q = 16;
+ESC_BITS = 11;
+
+words = double(words(:));
+samples = [];
+nBlocks = 0;
+skipped = [];
+starts = [];
+mark = 0;
+p = 1;
+while p <= length(words)
+    k = floor(words(p) / 4096);
+    n = mod(words(p), 4096);
+    if k == MARK_K
+        mark = n;
+        p = p + 1;
+        continue;
+    end
+    if n == 0
+        break;
+    end
+    if k == RAW_K
+        if p + n > length(words)
+            break;
+        end
+        starts = [starts; length(samples) + 1];
+        skipped = [skipped; mark];
+        mark = 0;
+        samples = [samples; words(p+1 : p+n)];
+        p = p + n + 1;
+        nBlocks = nBlocks + 1;
+        continue;
+    end
+    if p + 2 > length(words)
+        break;
+    end
+    m = words(p+2);
+    if p + 2 + m > length(words)
+        break;
+    end
+    bits = dec2bin(words(p+3 : p+2+m), 16)';
+    bits = bits(:)' == '1';
+
+    block = zeros(n, 1);
+    block(1) = words(p+1);
+    b = 1;
+    ok = true;
+    for i = 2 : n
+        q = 0;
+        while q < ESC_Q && b <= length(bits) && bits(b)
+            q = q + 1;
+            b = b + 1;
+        end
+        if q == ESC_Q
+            nb = ESC_BITS;
+            base = 0;
+        else
+            b = b + 1;  % terminating zero
+            nb = k;
+            base = q * 2^k;
+        end
+        if b + nb - 1 > length(bits)
+            ok = false;
+            break;
+        end
+        u = base + sum(bits(b : b+nb-1) .* 2.^(nb-1:-1:0));
+        b = b + nb;
+        if mod(u, 2) == 0
+            d = u / 2;
+        else
+            d = -(u + 1) / 2;
+        end
+        block(i) = block(i-1) + d;
+    end
+    if ~ok
+        break;
+    end
+    starts = [starts; length(samples) + 1];
+    skipped = [skipped; mark];
+    mark = 0;
+    samples = [samples; block];
+    p = p + 3 + m;
+    nBlocks = nBlocks + 1;
+end
+end
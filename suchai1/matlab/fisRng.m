@@ -0,0 +1,34 @@
+function codes = fisRng(seed, n)
+% FISRNG bit-exact reference of fis_rng() (SUCHAI 2/3 expFis firmware)
+%   codes = FISRNG(seed, n) returns the 16 bits DAC codes of the points n
+%   (vector, taken mod 2^32) of the stimulus of seed. Point k of round r is
+%   n = r*points + k, the burn-in before it is k-inb4 .. k-1 (negative values
+%   wrap as in the firmware). points and inb4 are in the geometry record
+%   (0x6E03) of the run, 16000 and 500 by default. With the SUCHAI 1 profile
+%   (roundSeed, see fisGeometry) round r is fisRng(seed + r, 0:points-1).
+%
+%   x = n ^ (seed * 0x9E3779B9), then the murmur3 fmix32 finalizer:
+%   x ^= x >> 16; x *= 0x85EBCA6B; x ^= x >> 13; x *= 0xC2B2AE35; x ^= x >> 16
+%   codes = x >> 16
+%
+%   Example, the Vin of the first round: fisRng(seed, 0:15999)
+
+x = mod(double(n(:)), 2^32);
+s = mulmod32(double(seed), hex2dec('9E3779B9'));
+x = bitxor(x, s);
+x = bitxor(x, floor(x / 2^16));
+x = mulmod32(x, hex2dec('85EBCA6B'));
+x = bitxor(x, floor(x / 2^13));
+x = mulmod32(x, hex2dec('C2B2AE35'));
+x = bitxor(x, floor(x / 2^16));
+codes = floor(x / 2^16);
+end
+
+function r = mulmod32(a, b)
+% (a*b) mod 2^32 without losing bits in double precision
+al = mod(a, 2^16);
+ah = floor(a / 2^16);
+bl = mod(b, 2^16);
+bh = floor(b / 2^16);
+r = mod(mod(ah .* bl + al .* bh, 2^16) * 2^16 + al .* bl, 2^32);
+end
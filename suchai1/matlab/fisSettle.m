@@ -0,0 +1,69 @@
+function [data, skipped, starts] = fisSettle(words)
+% FISSETTLE removes the transient rejection marks of the expFis raw data
+%   [data, skipped, starts] = FISSETTLE(words) takes the 16 bits words saved
+%   by pay_exec_expFis with the on-board transient rejection on
+%   (pay_set_settle_expFis) and returns the samples without the marks
+%   (0xD000 | points), the points discarded at the beginning of each buffer
+%   and the index in data of the first sample of each buffer.
+%
+%   The samples of buffer b are data(starts(b) : starts(b+1)-1); they begin
+%   skipped(b) points after the first point of that buffer. Only a buffer
+%   that follows a pause has skipped(b) > 0.
+%
+%   The records saved with the samples (timing 0x71ED, geometry 0x6E03,
+%   stats 0x57A7, histogram 0x4157 and ISR 0x15B0, fis_payload.h and
+%   fis_stats.h) are dropped first, so their words are not taken as marks;
+%   decode them from words with fisTiming and fisGeometry. The samples are 10
+%   bits, so they never look like a record id.
+%
+%   Only for FIS_OUTPUT_RAW data: a Rice bitstream word may also begin with
+%   0xD. Compressed data (FIS_OUTPUT_COMP) goes through fisRiceDecode, which
+%   reads the marks itself and returns the same skipped and starts.
+
+MARK = hex2dec('D000');
+
+words = double(words(:));
+keep = true(size(words));
+p = 1;
+while p <= length(words)
+    len = recordLen(words, p);
+    if len > 0
+        keep(p : min(p+len-1, end)) = false;
+        p = p + len;
+    else
+        p = p + 1;
+    end
+end
+words = words(keep);
+
+isMark = bitand(words, hex2dec('F000')) == MARK;
+skipped = words(isMark) - MARK;
+markIdx = find(isMark);
+starts = markIdx - (0:length(markIdx)-1)';
+data = words(~isMark);
+end
+
+function len = recordLen(w, q)
+% words of the record starting at w(q), 0 if w(q) is not a record id
+last = length(w);
+switch w(q)
+    case hex2dec('71ED')    % timing, 15 + 2*nstamps, nstamps at word 14
+        len = 15;
+        if q + 14 <= last
+            len = 15 + 2*w(q+14);
+        end
+    case hex2dec('6E03')    % geometry
+        len = 14;
+    case hex2dec('57A7')    % stats
+        len = 25;
+    case hex2dec('4157')    % histogram, 13 + 2*nbins, nbins at word 3
+        len = 13;
+        if q + 3 <= last
+            len = 13 + 2*w(q+3);
+        end
+    case hex2dec('15B0')    % ISR stats, 4 ISR blocks
+        len = 6 + 10*4;
+    otherwise
+        len = 0;
+end
+end
@@ -0,0 +1,52 @@
+function t = fisTiming(words, fcy)
+% FISTIMING decodes the expFis timing records (FIS_OUTPUT_TIME, fis_payload.h)
+%   t = FISTIMING(words, fcy) finds the timing records (id 0x71ED) in the
+%   vector of 16 bits words saved by pay_exec_expFis and returns a struct
+%   array, one element per sens_buff. fcy is the instruction clock in Hz
+%   (Timer2 counts Tcy).
+%
+%   Fields: buff, adcPeriod, seed, samples, every, start and stop (clock of
+%   the first and last sample, s), tmrStart and tmrEnd ([TMR4 TMRadc]),
+%   stamps (s) and dTSampling, the measured time between samples (s), to be
+%   used instead of payloadLinearFit:
+%       freq = computeFreqSignalHz(adcPeriod, samplingCoeff, mean([t.dTSampling]))
+%   The raw data words of the same run are the ones between two records.
+
+ID = hex2dec('71ED');
+HEADER_LEN = 15;
+MAX_STAMPS = 8;
+
+words = double(words(:));
+t = struct('buff', {}, 'adcPeriod', {}, 'seed', {}, 'samples', {}, ...
+    'every', {}, 'start', {}, 'stop', {}, 'tmrStart', {}, 'tmrEnd', {}, ...
+    'stamps', {}, 'dTSampling', {});
+p = 1;
+while p + HEADER_LEN - 1 <= length(words)
+    n = words(p+14);
+    if words(p) ~= ID || n > MAX_STAMPS || p + HEADER_LEN + 2*n - 1 > length(words)
+        p = p + 1;
+        continue;
+    end
+    r.buff = words(p+3);
+    r.adcPeriod = words(p+1);
+    r.seed = words(p+2);
+    r.samples = words(p+4);
+    r.every = words(p+5);
+    start = toLong(words(p+6 : p+7));
+    stop = toLong(words(p+8 : p+9));
+    r.start = start / fcy;
+    r.stop = r.start + mod(stop - start, 2^32) / fcy;
+    r.tmrStart = words(p+10 : p+11)';
+    r.tmrEnd = words(p+12 : p+13)';
+    stamps = toLong(reshape(words(p+15 : p+14+2*n), 2, []));
+    r.stamps = r.start + mod(stamps(:) - start, 2^32) / fcy;
+    r.dTSampling = (r.stop - r.start) / (r.samples - 1);
+    t(end+1) = r; %#ok<AGROW>
+    p = p + HEADER_LEN + 2*n;
+end
+end
+
+function x = toLong(w)
+% low word first
+x = w(1,:) + w(2,:) * 2^16;
+end
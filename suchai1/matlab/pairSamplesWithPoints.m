@@ -1,6 +1,8 @@
 function [pairedValues, Samples, Points] = pairSamplesWithPoints(values,...
     dataReceived, sizeTM, oversamplingcoeff)
 %size of values and dataReceived MUST BE EQUAL
+%with on-board reduction (fisGeometry reduce > 0) there is one value per
+%point, use oversamplingcoeff = 1
 
 %% Detect samples not received 4 times
 samplesRcv = dataReceived;
@@ -1,4 +1,9 @@
-function [buffer, tmParameters] = processOneTelemetry(FID, adcPeriod)
+function [buffer, tmParameters] = processOneTelemetry(FID, adcPeriod, compressed)
+% compressed (optional, default false): the telemetry holds the blocks of
+% pay_exec_expFis with FIS_OUTPUT_COMP, decoded with fisRiceDecode
+if nargin < 3
+    compressed = false;
+end
 regexBeginCmd =  '0x0100,0x0000,0x0008,';
 regexContinueCmd = '0x0300';
 regexEndCmd = '0x0200';
@@ -119,6 +124,20 @@ while ischar(tline)
     tline = fgets(FID);
 end
 
+%% Compressed blocks
+% the position of the samples after a lost frame is unknown, so only the
+% blocks before the first lost frame are decoded
+if compressed
+    if ~isempty(dataLost)
+        values = values(1 : min(length(values), min(dataLost)));
+    end
+    [values, nBlocks] = fisRiceDecode(values);
+    values = values(1 : min(length(values), sizeTMSended));
+    dataReceived = 0 : length(values)-1;
+    dataLost = length(values) : sizeTMSended-1;
+    tmParameters.compressedBlocks = nBlocks;
+end
+
 if length(values) > sizeTMSended
     values = values(1: sizeTMSended);
 end
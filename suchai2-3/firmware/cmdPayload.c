@@ -24,64 +24,131 @@
 cmdFunction payFunction[PAY_NCMD];
 int pay_sysReq[PAY_NCMD];
 
+extern xQueueHandle dispatcherQueue;    //pay_sweep_tick
+
 #define _VERBOSE_ 1
 #define TEST2_MSJS 1
 
 // 1 = time, samples, time, samples, .. | 0 = time, samples, samples, ..
 #define PAY_TSPAIR_nSLIST   (1)
 
+/*
+ * One row per payload, indexed by DAT_Payload_Buff. The FP2 takes every
+ * run once every 6 ticks (10 s each, 1 min) and 95*2 times (two orbits of
+ * 95 min) before stopping
+ */
+#define PAY_FP2_EXEC_RATE (6)
+#define PAY_FP2_TAKE_TIMES (95*2)
+
+static const PAY_Descriptor pay_table[dat_pay_last_one] = {
+    [dat_pay_tmEstado] = {pay_id_isAlive_tmEstado, pay_isAlive_tmEstado, pay_get_state_tmEstado, pay_set_state_tmEstado,
+        pay_init_tmEstado, pay_take_tmEstado, pay_stop_tmEstado, mem_pay_tmEstado_state,
+        CMD_SYSREQ_MIN, 1, PAY_FP2_EXEC_RATE, PAY_FP2_TAKE_TIMES},
+    [dat_pay_battery] = {pay_id_isAlive_battery, pay_isAlive_battery, pay_get_state_battery, pay_set_state_battery,
+        pay_init_battery, pay_take_battery, pay_stop_battery, mem_pay_battery_state,
+        CMD_SYSREQ_MIN, 0, PAY_FP2_EXEC_RATE, PAY_FP2_TAKE_TIMES},
+    [dat_pay_debug] = {pay_id_isAlive_debug, pay_isAlive_debug, pay_get_state_debug, pay_set_state_debug,
+        pay_init_debug, pay_take_debug, pay_stop_debug, mem_pay_debug_state,
+        CMD_SYSREQ_MIN, 0, PAY_FP2_EXEC_RATE, PAY_FP2_TAKE_TIMES},
+    [dat_pay_langmuirProbe] = {pay_id_isAlive_langmuirProbe, pay_isAlive_langmuirProbe, pay_get_state_langmuirProbe, pay_set_state_langmuirProbe,
+        pay_init_langmuirProbe, pay_take_langmuirProbe, pay_stop_langmuirProbe, mem_pay_langmuirProbe_state,
+        CMD_SYSREQ_MIN, 0, PAY_FP2_EXEC_RATE, PAY_FP2_TAKE_TIMES},
+    [dat_pay_gps] = {pay_id_isAlive_gps, pay_isAlive_gps, pay_get_state_gps, pay_set_state_gps,
+        pay_init_gps, pay_take_gps, pay_stop_gps, mem_pay_gps_state,
+        CMD_SYSREQ_MIN + SCH_PAY_GPS_SYS_REQ, 25, PAY_FP2_EXEC_RATE, PAY_FP2_TAKE_TIMES},   //take: gps_cmdnum => RMC nmea sentence
+    [dat_pay_camera] = {pay_id_isAlive_camera, pay_isAlive_camera, pay_get_state_camera, pay_set_state_camera,
+        pay_init_camera, pay_take_camera, pay_stop_camera, mem_pay_camera_state,
+        CMD_SYSREQ_MIN, 0, PAY_FP2_EXEC_RATE, PAY_FP2_TAKE_TIMES},
+    [dat_pay_sensTemp] = {pay_id_isAlive_sensTemp, pay_isAlive_sensTemp, pay_get_state_sensTemp, pay_set_state_sensTemp,
+        pay_init_sensTemp, pay_take_sensTemp, pay_stop_sensTemp, mem_pay_sensTemp_state,
+        CMD_SYSREQ_MIN, 0, PAY_FP2_EXEC_RATE, PAY_FP2_TAKE_TIMES},
+    [dat_pay_gyro] = {pay_id_isAlive_gyro, pay_isAlive_gyro, pay_get_state_gyro, pay_set_state_gyro,
+        pay_init_gyro, pay_take_gyro, pay_stop_gyro, mem_pay_gyro_state,
+        CMD_SYSREQ_MIN, 0, PAY_FP2_EXEC_RATE, PAY_FP2_TAKE_TIMES},
+    [dat_pay_expFis] = {pay_id_isAlive_expFis, pay_isAlive_expFis, pay_get_state_expFis, pay_set_state_expFis,
+        pay_init_expFis, pay_take_expFis, pay_stop_expFis, mem_pay_expFis_state,
+        CMD_SYSREQ_MIN, 0, PAY_FP2_EXEC_RATE, PAY_FP2_TAKE_TIMES},
+};
+
+//FP2 rate and takes of each payload, from pay_table on reset, can be changed by command
+static unsigned int pay_fp2_exec_rate[dat_pay_last_one];
+static unsigned int pay_fp2_take_times[dat_pay_last_one];
+
+/*
+ * FP2 deadlines: pay_fp2_next_tick[pay_i] is the tick of the next run of
+ * pay_i and pay_fp2_next_due the earliest of them, so a tick with nothing
+ * due returns without looking at any payload
+ */
+static unsigned long pay_fp2_tick;
+static unsigned long pay_fp2_next_tick[dat_pay_last_one];
+static unsigned long pay_fp2_next_due;
+
+static void pay_fp2_update_next_due(void){
+    DAT_Payload_Buff pay_i;
+    pay_fp2_next_due = pay_fp2_next_tick[0];
+    for(pay_i = 1; pay_i < dat_pay_last_one; pay_i++){
+        if(pay_fp2_next_tick[pay_i] < pay_fp2_next_due){
+            pay_fp2_next_due = pay_fp2_next_tick[pay_i];
+        }
+    }
+}
+
+/*
+ * RAM copy of mem_pay_expFis_sweep_len and mem_pay_expFis_sweep_idx, loaded
+ * in pay_onResetCmdPAY, so the FP2 tick does not read MemEEPROM
+ */
+static unsigned int pay_sweep_len = 0;     //words of the plan
+static unsigned int pay_sweep_ck = 0;      //FIS_SWEEP_ACTIVE | attempts << 8 | entry index
+static BOOL pay_sweep_running = FALSE;     //pay_sweep_entry_expFis is running
+static BOOL pay_sweep_sent = FALSE;        //the next entry was dispatched
+static unsigned long pay_sweep_sent_tick;
+
+static void pay_sweep_load(void){
+    pay_sweep_len = (unsigned int)mem_getVar(mem_pay_expFis_sweep_len);
+    pay_sweep_ck = (unsigned int)mem_getVar(mem_pay_expFis_sweep_idx);
+    pay_sweep_sent = FALSE;
+}
+
+
 void pay_onResetCmdPAY(void){
     printf("        pay_onResetCmdPAY\n");
 
     int i;
     for(i=0; i<PAY_NCMD; i++) pay_sysReq[i] = CMD_SYSREQ_MIN;
 
+    //isAlive, get_state, set_state, init, take and stop of every payload
+    DAT_Payload_Buff pay_i;
+    const PAY_Descriptor *d;
+    for(pay_i = 0; pay_i < dat_pay_last_one; pay_i++){
+        d = &pay_table[pay_i];
+        payFunction[(unsigned char)(d->id_isAlive + 0)] = d->isAlive;
+        payFunction[(unsigned char)(d->id_isAlive + 1)] = d->get_state;
+        payFunction[(unsigned char)(d->id_isAlive + 2)] = d->set_state;
+        payFunction[(unsigned char)(d->id_isAlive + 3)] = d->init;
+        payFunction[(unsigned char)(d->id_isAlive + 4)] = d->take;
+        payFunction[(unsigned char)(d->id_isAlive + 5)] = d->stop;
+        pay_sysReq[(unsigned char)(d->id_isAlive + 0)] = d->sys_req;
+        pay_sysReq[(unsigned char)(d->id_isAlive + 3)] = d->sys_req;
+        pay_sysReq[(unsigned char)(d->id_isAlive + 4)] = d->sys_req;
+        pay_sysReq[(unsigned char)(d->id_isAlive + 5)] = d->sys_req;
+        pay_fp2_exec_rate[pay_i] = d->exec_rate;
+        pay_fp2_take_times[pay_i] = d->take_times;
+        pay_fp2_next_tick[pay_i] = pay_fp2_tick + d->exec_rate;
+    }
+    pay_fp2_update_next_due();
+    payFunction[(unsigned char)pay_id_fp2_set_rate] = pay_fp2_set_rate;
+    payFunction[(unsigned char)pay_id_fp2_set_take_times] = pay_fp2_set_take_times;
+
     payFunction[(unsigned char)pay_id_test_dataRepo] = pay_test_dataRepo;
     payFunction[(unsigned char)pay_id_fp2_default_fsm] = pay_fp2_default_fsm;
 
-    payFunction[(unsigned char)pay_id_isAlive_tmEstado] = pay_isAlive_tmEstado;
-    payFunction[(unsigned char)pay_id_get_state_tmEstado] = pay_get_state_tmEstado;
-    payFunction[(unsigned char)pay_id_set_state_tmEstado] = pay_set_state_tmEstado;
-    payFunction[(unsigned char)pay_id_init_tmEstado] = pay_init_tmEstado;
-    payFunction[(unsigned char)pay_id_take_tmEstado] = pay_take_tmEstado;
-    payFunction[(unsigned char)pay_id_stop_tmEstado] = pay_stop_tmEstado;
-
-    payFunction[(unsigned char)pay_id_isAlive_sensTemp] = pay_isAlive_sensTemp;
-    payFunction[(unsigned char)pay_id_get_state_sensTemp] = pay_get_state_sensTemp;
-    payFunction[(unsigned char)pay_id_set_state_sensTemp] = pay_set_state_sensTemp;
-    payFunction[(unsigned char)pay_id_init_sensTemp] = pay_init_sensTemp;
-    payFunction[(unsigned char)pay_id_take_sensTemp] = pay_take_sensTemp;
-    payFunction[(unsigned char)pay_id_stop_sensTemp] = pay_stop_sensTemp;
     payFunction[(unsigned char)pay_id_debug_sensTemp] = pay_debug_sensTemp;
 
-    payFunction[(unsigned char)pay_id_isAlive_gyro] = pay_isAlive_gyro;
-    payFunction[(unsigned char)pay_id_get_state_gyro] = pay_get_state_gyro;
-    payFunction[(unsigned char)pay_id_set_state_gyro] = pay_set_state_gyro;
-    payFunction[(unsigned char)pay_id_init_gyro] = pay_init_gyro;
-    payFunction[(unsigned char)pay_id_take_gyro] = pay_take_gyro;
-    payFunction[(unsigned char)pay_id_stop_gyro] = pay_stop_gyro;
     payFunction[(unsigned char)pay_id_debug_gyro] = pay_debug_gyro;
 
-    payFunction[(unsigned char)pay_id_isAlive_camera] = pay_isAlive_camera;
-    payFunction[(unsigned char)pay_id_get_state_camera] = pay_get_state_camera;
-    payFunction[(unsigned char)pay_id_set_state_camera] = pay_set_state_camera;
-    payFunction[(unsigned char)pay_id_init_camera] = pay_init_camera;
-    payFunction[(unsigned char)pay_id_take_camera] = pay_take_camera;
-    payFunction[(unsigned char)pay_id_stop_camera] = pay_stop_camera;
     payFunction[(unsigned char)pay_id_takePhoto_camera] = pay_takePhoto_camera;
     payFunction[(unsigned char)pay_id_get_savedPhoto_camera] = pay_get_savedPhoto_camera;
 
-    payFunction[(unsigned char)pay_id_get_state_gps] = pay_get_state_gps;
-    payFunction[(unsigned char)pay_id_set_state_gps] = pay_set_state_gps;
-    payFunction[(unsigned char)pay_id_isAlive_gps] = pay_isAlive_gps;
-    pay_sysReq[(unsigned char)pay_id_isAlive_gps] =  CMD_SYSREQ_MIN + SCH_PAY_GPS_SYS_REQ;
-    payFunction[(unsigned char)pay_id_init_gps] = pay_init_gps;
-    pay_sysReq[(unsigned char)pay_id_init_gps] =  CMD_SYSREQ_MIN + SCH_PAY_GPS_SYS_REQ;
-    payFunction[(unsigned char)pay_id_take_gps] = pay_take_gps;
-    pay_sysReq[(unsigned char)pay_id_take_gps] =  CMD_SYSREQ_MIN + SCH_PAY_GPS_SYS_REQ;
-    payFunction[(unsigned char)pay_id_stop_gps] = pay_stop_gps;
-    pay_sysReq[(unsigned char)pay_id_stop_gps] =  CMD_SYSREQ_MIN + SCH_PAY_GPS_SYS_REQ;
-
     payFunction[(unsigned char)pay_id_gps_updateRTC] = pay_gps_updateRTC;
     pay_sysReq[(unsigned char)pay_id_gps_updateRTC] =  CMD_SYSREQ_MIN;
     payFunction[(unsigned char)pay_id_gps_serial] = pay_gps_serial;
@@ -93,15 +160,25 @@ void pay_onResetCmdPAY(void){
     payFunction[(unsigned char)pay_id_gps_jsat] = pay_gps_jsat;
     pay_sysReq[(unsigned char)pay_id_gps_jsat] =  CMD_SYSREQ_MIN;
 
-    payFunction[(unsigned char)pay_id_isAlive_expFis] = pay_isAlive_expFis;
-    payFunction[(unsigned char)pay_id_get_state_expFis] = pay_get_state_expFis;
-    payFunction[(unsigned char)pay_id_set_state_expFis] = pay_set_state_expFis;
-    payFunction[(unsigned char)pay_id_init_expFis] = pay_init_expFis;
-    payFunction[(unsigned char)pay_id_take_expFis] = pay_take_expFis;
-    payFunction[(unsigned char)pay_id_stop_expFis] = pay_stop_expFis;
     payFunction[(unsigned char)pay_id_adhoc_expFis] = pay_adhoc_expFis;
     payFunction[(unsigned char)pay_id_set_seed_expFis] = pay_set_seed_expFis;
     payFunction[(unsigned char)pay_id_set_adcPeriod_expFis] = pay_set_adcPeriod_expFis;
+    payFunction[(unsigned char)pay_id_set_adcMode_expFis] = pay_set_adcMode_expFis;
+    payFunction[(unsigned char)pay_id_set_output_expFis] = pay_set_output_expFis;
+    payFunction[(unsigned char)pay_id_set_hist_expFis] = pay_set_hist_expFis;
+    payFunction[(unsigned char)pay_id_set_waveform_expFis] = pay_set_waveform_expFis;
+    payFunction[(unsigned char)pay_id_sweep_clear_expFis] = pay_sweep_clear_expFis;
+    payFunction[(unsigned char)pay_id_sweep_add_expFis] = pay_sweep_add_expFis;
+    payFunction[(unsigned char)pay_id_sweep_run_expFis] = pay_sweep_run_expFis;
+    payFunction[(unsigned char)pay_id_sweep_entry_expFis] = pay_sweep_entry_expFis;
+    payFunction[(unsigned char)pay_id_set_timing_expFis] = pay_set_timing_expFis;
+    payFunction[(unsigned char)pay_id_set_stamps_expFis] = pay_set_stamps_expFis;
+    payFunction[(unsigned char)pay_id_stats_expFis] = pay_stats_expFis;
+    payFunction[(unsigned char)pay_id_set_geometry_expFis] = pay_set_geometry_expFis;
+    payFunction[(unsigned char)pay_id_commit_geometry_expFis] = pay_commit_geometry_expFis;
+    payFunction[(unsigned char)pay_id_set_profile_expFis] = pay_set_profile_expFis;
+    payFunction[(unsigned char)pay_id_set_reduce_expFis] = pay_set_reduce_expFis;
+    payFunction[(unsigned char)pay_id_set_settle_expFis] = pay_set_settle_expFis;
     payFunction[(unsigned char)pay_id_print_seed] = pay_print_seed;
     payFunction[(unsigned char)pay_id_print_seed_full] = pay_print_seed_full;
     payFunction[(unsigned char)pay_id_testDAC_expFis] = pay_testDAC_expFis;
@@ -109,29 +186,16 @@ void pay_onResetCmdPAY(void){
     
     
     
-    payFunction[(unsigned char)pay_id_isAlive_battery] = pay_isAlive_battery;
-    payFunction[(unsigned char)pay_id_get_state_battery] = pay_get_state_battery;
-    payFunction[(unsigned char)pay_id_set_state_battery] = pay_set_state_battery;
-    payFunction[(unsigned char)pay_id_init_battery] = pay_init_battery;
-    payFunction[(unsigned char)pay_id_take_battery] = pay_take_battery;
-    payFunction[(unsigned char)pay_id_stop_battery] = pay_stop_battery;
     payFunction[(unsigned char)pay_id_execute_experiment_battery] = pay_execute_experiment_battery;
 
-    payFunction[(unsigned char)pay_id_isAlive_debug] = pay_isAlive_debug;
-    payFunction[(unsigned char)pay_id_get_state_debug] = pay_get_state_debug;
-    payFunction[(unsigned char)pay_id_set_state_debug] = pay_set_state_debug;
-    payFunction[(unsigned char)pay_id_init_debug] = pay_init_debug;
-    payFunction[(unsigned char)pay_id_take_debug] = pay_take_debug;
-    payFunction[(unsigned char)pay_id_stop_debug] = pay_stop_debug;
-
-    payFunction[(unsigned char)pay_id_isAlive_langmuirProbe] = pay_isAlive_langmuirProbe;
-    payFunction[(unsigned char)pay_id_get_state_langmuirProbe] = pay_get_state_langmuirProbe;
-    payFunction[(unsigned char)pay_id_set_state_langmuirProbe] = pay_set_state_langmuirProbe;
-    payFunction[(unsigned char)pay_id_init_langmuirProbe] = pay_init_langmuirProbe;
-    payFunction[(unsigned char)pay_id_take_langmuirProbe] = pay_take_langmuirProbe;
-    payFunction[(unsigned char)pay_id_stop_langmuirProbe] = pay_stop_langmuirProbe;
     payFunction[(unsigned char)pay_id_adhoc_langmuirProbe] = pay_adhoc_langmuirProbe;
     payFunction[(unsigned char)pay_id_send_to_langmuirProbe] = pay_send_to_langmuirProbe;
+
+    //a sweep plan started before the reset goes on at the next FP2 tick
+    pay_sweep_load();
+    if(pay_sweep_ck & FIS_SWEEP_ACTIVE){
+        printf("        expFis sweep plan resumes, %u entries pending\n", pay_sweep_pending());
+    }
 }
 
 
@@ -204,11 +268,24 @@ int pay_conf_data_repo_expFis(void){
 }
 
 int pay_exec_expFis(void *param){
-    int ind;
-    unsigned int temp;
+    unsigned int saved = 0;
     unsigned int timeout = 30;  //max time waiting to fill the sens_buffer
+    static unsigned int fis_rec[FIS_HIST_RECORD_LEN];    //FIS_HIST_RECORD_LEN > FIS_STATS_RECORD_LEN, FIS_TIME_RECORD_LEN, FIS_ISR_RECORD_LEN, FIS_GEOM_RECORD_LEN
+    unsigned int rec_len;
+    static unsigned int fis_comp_buff[FIS_COMP_BLOCK_LEN(FIS_SENS_BUFF_LEN)];
+    static unsigned int fis_red_buff[FIS_SENS_BUFF_LEN/2];     //one value per point, samples_per_point >= 2
+    const unsigned int *fis_out;    //samples saved by FIS_OUTPUT_RAW and FIS_OUTPUT_COMP
+    unsigned int out_size;
+    unsigned int fis_spp = fis_get_geometry()->samples_per_point;
+    unsigned int fis_red = (fis_spp > 1)? fis_get_reduce() : FIS_REDUCE_NONE;
+    unsigned int fis_skip;  //points of transient at the beginning of sens_buff
+    unsigned int fis_mark;
+    unsigned int fis_output = fis_get_output();
+    BOOL fis_pairs = (fis_get_adcMode() == FIS_ADC_HW_DUAL)? TRUE : FALSE;  //sens_buff holds (Vout, Vin) pairs
     
     fis_reset_iteration_variables();
+    fis_stats_reset();
+    fis_hist_reset();
     
     unsigned int buff_size = fis_get_sens_buff_size();
     unsigned int fis_state = fis_get_state();    //get the initial state of the Payload
@@ -219,37 +296,113 @@ int pay_exec_expFis(void *param){
         //so we must save the current data inside "sens_buff" into the Data Repository
         //and then resume the Payload execution
         fis_iterate(&rc, timeout);
+        if((int)rc < 0){
+            fis_state = fis_get_state();    //cause of the error, before stopping
+            fis_iterate_stop();     //the ISRs are still armed after a timeout
+            break;                  //and the partial sens_buff is not saved
+        }
 
-        for(ind=0;ind<buff_size;ind++){
-            //save the data into the Data Repository
-            temp = fis_get_sens_buff_i(ind);
-            dat_set_Payload_Buff(dat_pay_expFis, temp);
-
+        //update the statistics with the samples of this sens_buff
+        if((fis_output & FIS_OUTPUT_STATS) && fis_sens_buff_isFull()){
+            fis_stats_add_buff(fis_get_sens_buff(), fis_get_dac_buff(), buff_size, fis_pairs);
+        }
+        if((fis_output & FIS_OUTPUT_HIST) && fis_sens_buff_isFull()){
+            fis_hist_add_buff(fis_get_sens_buff(), fis_get_dac_buff(), buff_size, fis_pairs);
+        }
+        //every sample, or one value per DAC point, without the settling transient
+        fis_out = fis_get_sens_buff();
+        out_size = buff_size;
+        if(fis_get_settle() != 0 && fis_sens_buff_isFull()){
+            fis_skip = fis_sens_buff_settle();
+            fis_out += fis_skip*fis_spp*((fis_pairs)? 2 : 1);
+            out_size -= fis_skip*fis_spp*((fis_pairs)? 2 : 1);
+            fis_mark = FIS_SETTLE_MARK | fis_skip;
+            if(fis_output & (FIS_OUTPUT_RAW | FIS_OUTPUT_COMP)){
+                pay_set_Payload_Buff_block(dat_pay_expFis, &fis_mark, 1);
+            }
+        }
+        if(fis_red != FIS_REDUCE_NONE && (fis_output & (FIS_OUTPUT_RAW | FIS_OUTPUT_COMP))){
+            out_size = fis_reduce_buff(fis_out, out_size, fis_spp, fis_pairs, fis_red, fis_red_buff);
+            fis_out = fis_red_buff;
+        }
+        //save the data into the Data Repository, straight from sens_buff
+        if(fis_output & FIS_OUTPUT_RAW){
+            saved = pay_set_Payload_Buff_block(dat_pay_expFis, fis_out, out_size);
+        }
+        //or save it as one compressed block
+        if(fis_output & FIS_OUTPUT_COMP){
+            rec_len = fis_comp_encode(fis_out, out_size, fis_comp_buff);
+            saved = pay_set_Payload_Buff_block(dat_pay_expFis, fis_comp_buff, rec_len);
             #if FIS_CMD_VERBOSE > 0
-               printf("    dat_set_Payload_Buff(%u)\n",temp);
+               printf("    fis_comp_encode(%u samples => %u words)\n", out_size, rec_len);
             #endif
-
         }
+        //timer snapshots of this sens_buff, right after its samples
+        if((fis_output & FIS_OUTPUT_TIME) && fis_sens_buff_isFull()){
+            rec_len = fis_time_get_record(fis_rec);
+            pay_set_Payload_Buff_block(dat_pay_expFis, fis_rec, rec_len);
+        }
+        fis_sens_buff_release();    //the ISRs can fill this sens_buff again
+
+        #if FIS_CMD_VERBOSE > 0
+           printf("    pay_set_Payload_Buff_block(%u/%u)\n", saved, out_size);
+        #endif
 
         printf("Clearing WDT \n");
         ClrWdt();
     }
 
     //Payload end
-    if(rc<0){   //fis_iterate finished with error
-        fis_state = fis_get_state();    //use the state to see the cause of error
+    if((int)rc < 0){   //fis_iterate finished with error
         #if FIS_CMD_VERBOSE
             printf("fis_iterate() finished with error ");
             printf("fis_state= 0x%X\n",fis_state);
         #endif
     }
+    //one summary record per run (adcPeriod/seed)
+    if(fis_output & FIS_OUTPUT_STATS){
+        fis_stats_get_record(fis_rec, fis_get_adcPeriod(), fis_get_seed());
+        saved = pay_set_Payload_Buff_block(dat_pay_expFis, fis_rec, FIS_STATS_RECORD_LEN);
+        #if FIS_CMD_VERBOSE > 0
+            printf("    stats record pay_set_Payload_Buff_block(%u/%u)\n", saved, (unsigned int)FIS_STATS_RECORD_LEN);
+        #endif
+        #if FIS_ISR_STATS
+            //ISR load of the same run
+            rec_len = fis_isr_get_record(fis_rec);
+            saved = pay_set_Payload_Buff_block(dat_pay_expFis, fis_rec, rec_len);
+        #endif
+        //geometry of the run, to split the raw samples on ground
+        rec_len = fis_geom_get_record(fis_rec);
+        saved = pay_set_Payload_Buff_block(dat_pay_expFis, fis_rec, rec_len);
+    }
+    if(fis_output & FIS_OUTPUT_HIST){
+        rec_len = fis_hist_get_record(fis_rec, fis_get_adcPeriod(), fis_get_seed());
+        saved = pay_set_Payload_Buff_block(dat_pay_expFis, fis_rec, rec_len);
+        #if FIS_CMD_VERBOSE > 0
+            printf("    hist record pay_set_Payload_Buff_block(%u/%u)\n", saved, rec_len);
+        #endif
+    }
+    #if FIS_CMD_VERBOSE > 0
+        printf("fis_get_resume_count() = %u\n", fis_get_resume_count());
+        printf("fis_get_dac_underrun_count() = %u\n", fis_get_dac_underrun_count());
+        #if FIS_ISR_STATS
+            fis_isr_print();
+        #endif
+    #endif
     //return -1 if failed (rc < 0)
     //return +1 if succesfull (rc > 0)
     printf("pay_exec finished\n");
-    return (rc < 0)? 0 : 1;
+    return ((int)rc < 0)? 0 : 1;
 
 }
 
+/**
+ * Loads the original adhoc sweep (10 adcPeriod x 3 seeds, 1 round each) as the
+ * sweep plan, unless a plan is still in progress, and starts it. The entries
+ * run in the background, dispatched by the FP2 (see pay_sweep_tick)
+ * @param param not used
+ * @return 1
+ */
 int pay_adhoc_expFis(void *param){
     
     unsigned int frec[] = {4, 7, 13, 21, 36, 61, 104, 175, 295, 498, 840, 1417,
@@ -257,19 +410,194 @@ int pay_adhoc_expFis(void *param){
     unsigned int seedd[] = {0, 1000, 5000};
     int frec_len = 10;
     int seed_len = 3;
+    unsigned int mode = fis_get_adcMode() | (fis_get_waveform() << 4) | (fis_get_output() << 8);
+    unsigned int rounds = 1;
+    unsigned int start = 1;
     
-    int res, i, j;
-    for (i = 0; i < frec_len; i++ ) {
-        for(j = 0; j < seed_len; j++ ) {
-            pay_set_adcPeriod_expFis(&frec[i]);
-            pay_set_seed_expFis(&seedd[j]);
-            pay_conf_data_repo_expFis();
-            res = pay_exec_expFis(0);
+    int i, j;
+    if(pay_sweep_pending() == 0){
+        pay_sweep_clear_expFis(0);
+        for (i = 0; i < frec_len; i++ ) {
+            for(j = 0; j < seed_len; j++ ) {
+                pay_sweep_add_expFis(&frec[i]);
+                pay_sweep_add_expFis(&seedd[j]);
+                pay_sweep_add_expFis(&rounds);
+                pay_sweep_add_expFis(&mode);
+            }
         }
     }
     
+    return pay_sweep_run_expFis(&start);
+
+}
+
+static int pay_sweep_get(unsigned int i){
+    return mem_getVar((MemEEPROM_Vars)(mem_pay_expFis_sweep_plan + i));
+}
+
+static void pay_sweep_set_ck(unsigned int ck){
+    pay_sweep_ck = ck;
+    mem_setVar(mem_pay_expFis_sweep_idx, ck);
+}
+
+/*
+ * Number of entries of the sweep plan not executed yet
+ */
+unsigned int pay_sweep_pending(void){
+    unsigned int len = pay_sweep_len / FIS_SWEEP_ENTRY_LEN;
+    unsigned int idx = pay_sweep_ck & 0x00FF;
+    return (idx < len)? len - idx : 0;
+}
+
+/**
+ * Erases the sweep plan and its progress
+ * @param param not used
+ * @return 1
+ */
+int pay_sweep_clear_expFis(void *param){
+    pay_sweep_len = 0;
+    mem_setVar(mem_pay_expFis_sweep_len, 0);
+    pay_sweep_set_ck(0);
+    #if FIS_CMD_VERBOSE > 0
+        printf("    pay_sweep_clear_expFis done\n");
+    #endif
+    return 1;
+}
+
+/**
+ * Appends one word to the sweep plan. An entry is complete every
+ * FIS_SWEEP_ENTRY_LEN words: adcPeriod, seed, rounds, mode
+ * @param param word to append
+ * @return 1 if success, 0 if the plan is full
+ */
+int pay_sweep_add_expFis(void *param){
+    unsigned int word = *((unsigned int *) param);
+    if(pay_sweep_len >= FIS_SWEEP_MAX_ENTRIES*FIS_SWEEP_ENTRY_LEN){
+        printf("    pay_sweep_add_expFis: sweep plan is full\n");
+        return 0;
+    }
+    mem_setVar((MemEEPROM_Vars)(mem_pay_expFis_sweep_plan + pay_sweep_len), word);
+    pay_sweep_len++;
+    mem_setVar(mem_pay_expFis_sweep_len, pay_sweep_len);
+    return 1;
+}
+
+/**
+ * Starts or stops the sweep plan in the background. The FIS_SWEEP_ACTIVE
+ * flag is kept in MemEEPROM with the progress, so a started plan goes on
+ * after a reset from the entry it was on
+ * @param param 1 starts (or continues) the plan, 0 stops it
+ * @return 1 if success, 0 if there is nothing to start
+ */
+int pay_sweep_run_expFis(void *param){
+    unsigned int start = *((unsigned int *) param);
+
+    if(start != 0 && pay_sweep_pending() == 0){
+        printf("    pay_sweep_run_expFis: sweep plan is empty or done\n");
+        return 0;
+    }
+    pay_sweep_set_ck((start != 0)? (pay_sweep_ck | FIS_SWEEP_ACTIVE) : (pay_sweep_ck & ~FIS_SWEEP_ACTIVE));
+    #if FIS_CMD_VERBOSE > 0
+        printf("    pay_sweep_run_expFis: %s, %u entries pending\n", (start != 0)? "started" : "stopped", pay_sweep_pending());
+    #endif
+    return 1;
+}
+
+/**
+ * Runs one entry of the sweep plan, dispatched by pay_sweep_tick. The
+ * progress is written to MemEEPROM before the entry starts (entry index and
+ * number of attempts), so after a reset the same entry is started again, at
+ * most FIS_SWEEP_MAX_ATTEMPTS times
+ * @param param index of the entry, must be the next one of the plan
+ * @return 1 if the entry was run, 0 if not
+ */
+int pay_sweep_entry_expFis(void *param){
+    unsigned int idx = *((unsigned int *) param);
+    unsigned int len = pay_sweep_len / FIS_SWEEP_ENTRY_LEN;
+    unsigned int attempts = (pay_sweep_ck >> 8) & 0x007F;
+    unsigned int adcPeriod, seed, rounds, mode;
+    int res;
+
+    pay_sweep_sent = FALSE;
+    if(pay_sweep_running || (pay_sweep_ck & FIS_SWEEP_ACTIVE) == 0
+            || idx != (pay_sweep_ck & 0x00FF) || idx >= len){
+        printf("    pay_sweep_entry_expFis: entry %u is not the next one\n", idx);
+        return 0;
+    }
+    pay_sweep_running = TRUE;
+    attempts++;
+    pay_sweep_set_ck(FIS_SWEEP_ACTIVE | idx | (attempts << 8));   //checkpoint
+
+    adcPeriod = (unsigned int)pay_sweep_get(idx*FIS_SWEEP_ENTRY_LEN + 0);
+    seed = (unsigned int)pay_sweep_get(idx*FIS_SWEEP_ENTRY_LEN + 1);
+    rounds = (unsigned int)pay_sweep_get(idx*FIS_SWEEP_ENTRY_LEN + 2);
+    mode = (unsigned int)pay_sweep_get(idx*FIS_SWEEP_ENTRY_LEN + 3);
+    #if FIS_CMD_VERBOSE > 0
+        printf("    pay_sweep_entry_expFis: entry %u/%u, adcPeriod %u, seed %u, rounds %u, mode 0x%X\n",
+                idx+1, len, adcPeriod, seed, rounds, mode);
+    #endif
+
+    fis_set_adcMode(mode & 0x000F);
+    fis_set_waveform((mode >> 4) & 0x000F);
+    fis_set_output(mode >> 8);
+    fis_set_adcPeriod(adcPeriod, rounds);
+    fis_set_seed(seed, rounds);
+    pay_conf_data_repo_expFis();
+    res = pay_exec_expFis(0);
+    #if FIS_CMD_VERBOSE > 0
+        printf("    pay_sweep_entry_expFis: entry %u returned %d\n", idx+1, res);
+    #endif
+
+    //the last entry also clears FIS_SWEEP_ACTIVE, unless the plan was stopped meanwhile
+    idx++;
+    pay_sweep_set_ck(((pay_sweep_ck & FIS_SWEEP_ACTIVE) && idx < len)? (FIS_SWEEP_ACTIVE | idx) : idx);
+    pay_sweep_running = FALSE;
     return 1;
+}
 
+/**
+ * Checks if the next entry of an active sweep plan is due and dispatches it
+ * as a pay_id_sweep_entry_expFis command, so the FP2 tick does not wait for
+ * the experiment. Only the RAM copy of the progress is read here; MemEEPROM
+ * is written when entries that failed too many times are skipped or when
+ * the plan is done. Called once per FP2 tick
+ * @return TRUE if an entry was dispatched
+ */
+BOOL pay_sweep_tick(void){
+    unsigned int len = pay_sweep_len / FIS_SWEEP_ENTRY_LEN;
+    unsigned int idx = pay_sweep_ck & 0x00FF;
+    unsigned int attempts = (pay_sweep_ck >> 8) & 0x007F;
+    DispCmd NewCmd;
+
+    if((pay_sweep_ck & FIS_SWEEP_ACTIVE) == 0 || pay_sweep_running){ return FALSE; }
+    //dispatched but not started yet, sent again if the command was dropped
+    if(pay_sweep_sent && (pay_fp2_tick - pay_sweep_sent_tick) < FIS_SWEEP_RETRY_TICKS){ return FALSE; }
+
+    //entries that already failed too many times are skipped
+    while(idx < len && attempts >= FIS_SWEEP_MAX_ATTEMPTS){
+        printf("    pay_sweep_tick: entry %u skipped after %u attempts\n", idx, attempts);
+        idx++;
+        attempts = 0;
+        pay_sweep_set_ck(FIS_SWEEP_ACTIVE | idx);
+    }
+    if(idx >= len){
+        pay_sweep_set_ck(idx);  //plan done
+        #if FIS_CMD_VERBOSE > 0
+            printf("    pay_sweep_tick: sweep plan done\n");
+        #endif
+        return FALSE;
+    }
+
+    NewCmd.cmdId = pay_id_sweep_entry_expFis;
+    NewCmd.idOrig = CMD_IDORIG_TFLIGHTPLAN2;
+    NewCmd.sysReq = CMD_SYSREQ_MIN;
+    NewCmd.param = (int)idx;
+    if(xQueueSend(dispatcherQueue, (const void *) &NewCmd, 0) != pdTRUE){
+        return FALSE;   //dispatcher busy, next tick
+    }
+    pay_sweep_sent = TRUE;
+    pay_sweep_sent_tick = pay_fp2_tick;
+    return TRUE;
 }
 
 int pay_set_seed_expFis(void *param) {
@@ -293,6 +621,236 @@ int pay_set_adcPeriod_expFis(void *param) {
     return 1;
 }
 
+/**
+ * Selects how the ADC conversions are started, see Fis_AdcModes
+ * @param param 0 = Timer5 ISR (soft trigger), 1 = Timer3 + ADC ISR (hardware trigger),
+ * 2 = Timer3 + one ADC ISR per DAC point (hardware burst), 3 = Timer3 + one
+ * ADC ISR per (Vout, Vin) pair, saved interleaved (hardware dual channel)
+ * @return 1
+ */
+int pay_set_adcMode_expFis(void *param) {
+    
+    unsigned int adcMode = *((unsigned int *) param);
+    printf("    pay_set_adcMode_expFis %u ...\n", adcMode);
+    fis_set_adcMode(adcMode);
+    printf("    pay_set_adcMode_expFis done\n");
+    
+    return 1;
+}
+
+/**
+ * Selects what pay_exec_expFis saves into dat_pay_expFis
+ * @param param Mask of FIS_OUTPUT_RAW (every sample), FIS_OUTPUT_STATS (one
+ * statistics record per run), FIS_OUTPUT_HIST (one histogram record per run)
+ * and FIS_OUTPUT_COMP (every sample, compressed)
+ * @return 1
+ */
+int pay_set_output_expFis(void *param) {
+    
+    unsigned int output = *((unsigned int *) param);
+    printf("    pay_set_output_expFis 0x%X ...\n", output);
+    fis_set_output(output);
+    printf("    pay_set_output_expFis done\n");
+    
+    return 1;
+}
+
+/**
+ * Configures the on-board histograms of Vout and power (FIS_OUTPUT_HIST).
+ * Vout bins are centered at mid scale and power bins at zero
+ * @param param bits 0-7 number of bins (1 to FIS_HIST_MAX_BINS), bits 8-11
+ * log2 of the Vout bin width, bits 12-15 log2 of the power bin width
+ * @return 1 if success, 0 if the configuration is invalid
+ */
+int pay_set_hist_expFis(void *param) {
+    
+    unsigned int conf = *((unsigned int *) param);
+    printf("    pay_set_hist_expFis 0x%X ...\n", conf);
+    BOOL res = fis_hist_config_centered(conf);
+    printf("    pay_set_hist_expFis done\n");
+    
+    return (res == TRUE)? 1 : 0;
+}
+
+/**
+ * Selects the stimulus of the DAC, see Fis_Waveforms
+ * @param param 0 = uniform noise, 1 = gaussian noise, 2 = PRBS15 (MLS),
+ * 3 = stepped sine, 4 = log chirp
+ * @return 1
+ */
+int pay_set_waveform_expFis(void *param) {
+    
+    unsigned int wave = *((unsigned int *) param);
+    printf("    pay_set_waveform_expFis %u ...\n", wave);
+    fis_set_waveform(wave);
+    printf("    pay_set_waveform_expFis done\n");
+    
+    return 1;
+}
+
+/**
+ * Selects what clocks the DAC updates
+ * @param param bits 0-7: one of Fis_Timings, bits 8-15: DAC to conversion
+ * phase in timer counts (FIS_ADC_SOFT_TRIGGER mode)
+ * @return 1
+ */
+int pay_set_timing_expFis(void *param) {
+    
+    unsigned int timing = *((unsigned int *) param);
+    printf("    pay_set_timing_expFis 0x%X ...\n", timing);
+    fis_set_timing(timing & 0x00FF, timing >> 8);
+    printf("    pay_set_timing_expFis done\n");
+    
+    return 1;
+}
+
+/**
+ * Prints the ISR statistics (latency, duration, missed deadlines and load) of
+ * the last run, see FIS_ISR_RECORD_ID
+ * @param param not used
+ * @return load of all the ISRs in 1/1000 of the running time, 0 if
+ * FIS_ISR_STATS is off
+ */
+int pay_stats_expFis(void *param) {
+    #if FIS_ISR_STATS
+        unsigned int rec[FIS_ISR_RECORD_LEN];
+        fis_isr_get_record(rec);
+        fis_isr_print();
+        return rec[5];
+    #else
+        printf("    pay_stats_expFis: FIS_ISR_STATS is off\n");
+        return 0;
+    #endif
+}
+
+//geometry being changed by pay_set_geometry_expFis, not applied yet
+static FIS_Geometry pay_geom_staged;
+static BOOL pay_geom_staged_valid = FALSE;
+
+/**
+ * Stages one field of the experiment geometry (see FIS_Geometry). Nothing is
+ * applied until pay_commit_geometry_expFis, so a change of several fields
+ * takes one command per field and a final commit
+ * @param param bits 14-15 field: 0 = signal_points, 1 = samples_per_point,
+ * 2 = buff_len, 3 = points_inb4; bits 0-13 value
+ * @return 1
+ */
+int pay_set_geometry_expFis(void *param) {
+    unsigned int conf = *((unsigned int *) param);
+    unsigned int value = conf & 0x3FFF;
+
+    printf("    pay_set_geometry_expFis 0x%X ...\n", conf);
+    if(!pay_geom_staged_valid){
+        pay_geom_staged = *fis_get_geometry();
+        pay_geom_staged_valid = TRUE;
+    }
+    switch(conf >> 14){
+        case 0: pay_geom_staged.signal_points = value; break;
+        case 1: pay_geom_staged.samples_per_point = value; break;
+        case 2: pay_geom_staged.buff_len = value; break;
+        default: pay_geom_staged.points_inb4 = value; break;
+    }
+    printf("    pay_set_geometry_expFis %u/%u/%u/%u staged\n", pay_geom_staged.signal_points,
+            pay_geom_staged.samples_per_point, pay_geom_staged.buff_len, pay_geom_staged.points_inb4);
+
+    return 1;
+}
+
+/**
+ * Applies or discards the geometry staged by pay_set_geometry_expFis. Either
+ * way the next change starts again from the geometry in use
+ * @param param 1 applies the staged geometry, 0 discards it
+ * @return 1 if applied (or discarded), 0 if nothing is staged or the staged
+ * geometry is invalid or expFis is running
+ */
+int pay_commit_geometry_expFis(void *param) {
+    unsigned int apply = *((unsigned int *) param);
+    BOOL res;
+
+    printf("    pay_commit_geometry_expFis %u ...\n", apply);
+    if(!pay_geom_staged_valid){
+        printf("    pay_commit_geometry_expFis: no geometry staged\n");
+        return 0;
+    }
+    pay_geom_staged_valid = FALSE;
+    if(apply == 0){
+        printf("    pay_commit_geometry_expFis: staged geometry discarded\n");
+        return 1;
+    }
+    res = fis_set_geometry(&pay_geom_staged);
+    printf("    pay_commit_geometry_expFis %u/%u/%u/%u %s\n", pay_geom_staged.signal_points,
+            pay_geom_staged.samples_per_point, pay_geom_staged.buff_len, pay_geom_staged.points_inb4,
+            (res == TRUE)? "applied" : "rejected");
+
+    return (res == TRUE)? 1 : 0;
+}
+
+/**
+ * Selects the mission profile (see Fis_Profiles): the geometry, ADC mode,
+ * timing, waveform and the burn-in, DAC parking and seeding behaviours of
+ * SUCHAI 1 or SUCHAI 2/3. The other set_xxx commands still apply on top of it
+ * @param param 0 = SUCHAI 2/3, 1 = SUCHAI 1
+ * @return 1 if success, 0 if expFis is running or the profile is invalid
+ */
+int pay_set_profile_expFis(void *param) {
+    
+    unsigned int profile = *((unsigned int *) param);
+    printf("    pay_set_profile_expFis %u ...\n", profile);
+    BOOL res = fis_set_profile(profile);
+    printf("    pay_set_profile_expFis done\n");
+    
+    return (res == TRUE)? 1 : 0;
+}
+
+/**
+ * Selects what FIS_OUTPUT_RAW and FIS_OUTPUT_COMP save of the
+ * samples_per_point samples of each DAC point, see Fis_Reductions
+ * @param param 0 = every sample, 1 = mean, 2 = median, 3 = last (settled) sample
+ * @return 1 if success, 0 if the mode is invalid
+ */
+int pay_set_reduce_expFis(void *param) {
+    
+    unsigned int mode = *((unsigned int *) param);
+    printf("    pay_set_reduce_expFis %u ...\n", mode);
+    fis_set_reduce(mode);
+    printf("    pay_set_reduce_expFis done\n");
+    
+    return (fis_get_reduce() == mode)? 1 : 0;
+}
+
+/**
+ * Discards the settling transient of the circuit at the beginning of each
+ * sens_buff that follows a pause. Each saved block (FIS_OUTPUT_RAW,
+ * FIS_OUTPUT_COMP) is then preceded by FIS_SETTLE_MARK | discarded points
+ * @param param bits 0-11 points to discard (0 = none, 0xFFF = found on
+ * board), bits 12-15 tolerance of the automatic mode in ADC counts (0 = 2)
+ * @return 1
+ */
+int pay_set_settle_expFis(void *param) {
+    
+    unsigned int settle = *((unsigned int *) param);
+    printf("    pay_set_settle_expFis 0x%X ...\n", settle);
+    fis_set_settle(settle & 0x0FFF, settle >> 12);
+    printf("    pay_set_settle_expFis done\n");
+    
+    return 1;
+}
+
+/**
+ * Selects the sparse sample timestamps of the timing record (FIS_OUTPUT_TIME)
+ * @param param samples between stamps, 0 = only the first and last sample
+ * @return 1
+ */
+int pay_set_stamps_expFis(void *param) {
+    
+    unsigned int every = *((unsigned int *) param);
+    printf("    pay_set_stamps_expFis %u ...\n", every);
+    fis_set_time_stamps(every);
+    printf("    pay_set_stamps_expFis done\n");
+    
+    return 1;
+}
+
 int pay_isAlive_expFis(void *param){
     /*
      * This Payload is mainly (DAC seems to basic to check isAlive with it)
@@ -306,9 +864,7 @@ int pay_isAlive_expFis(void *param){
  * @param not used
  */
 int pay_get_state_expFis(void *param){
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_expFis_state;
-    int res = mem_getVar(mem_eeprom_var);
-    return res;
+    return pay_get_state(dat_pay_expFis);    //RAM copy, see pay_state_load
 }
 /*
  * Sets the value for the MemEEPROM variable used by expFis
@@ -316,8 +872,10 @@ int pay_get_state_expFis(void *param){
  */
 int pay_set_state_expFis(void *param){
     int value = *( (int*)param );
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_expFis_state;
-    mem_setVar(mem_eeprom_var, value);
+    if(pay_set_state(dat_pay_expFis, value) == FALSE){
+        return 0;   //not a 4 bits state, see PAY_STATE_MAX
+    }
+    pay_state_flush();   //a command is saved right away
     return 1;
 }
 
@@ -424,15 +982,15 @@ int pay_isAlive_battery(void *param){
 }
 
 int pay_get_state_battery(void *param){
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_battery_state;
-    int res = mem_getVar(mem_eeprom_var);
-    return res;
+    return pay_get_state(dat_pay_battery);    //RAM copy, see pay_state_load
 }
 
 int pay_set_state_battery(void *param){
     int value = *( (int*)param );
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_battery_state;
-    mem_setVar(mem_eeprom_var, value);
+    if(pay_set_state(dat_pay_battery, value) == FALSE){
+        return 0;   //not a 4 bits state, see PAY_STATE_MAX
+    }
+    pay_state_flush();   //a command is saved right away
     return 1;
 }
 
@@ -541,14 +1099,14 @@ int pay_isAlive_debug(void *param){
     return 1;
 }
 int pay_get_state_debug(void *param){
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_debug_state;
-    int res = mem_getVar(mem_eeprom_var);
-    return res;
+    return pay_get_state(dat_pay_debug);    //RAM copy, see pay_state_load
 }
 int pay_set_state_debug(void *param){
     int value = *( (int*)param );
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_debug_state;
-    mem_setVar(mem_eeprom_var, value);
+    if(pay_set_state(dat_pay_debug, value) == FALSE){
+        return 0;   //not a 4 bits state, see PAY_STATE_MAX
+    }
+    pay_state_flush();   //a command is saved right away
     return 1;
 }
 static unsigned int pay_debug_cnt;
@@ -598,14 +1156,14 @@ int pay_isAlive_gyro(void *param){
     return gyr_isAlive();
 }
 int pay_get_state_gyro(void *param){
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_gyro_state;
-    int res = mem_getVar(mem_eeprom_var);
-    return res;
+    return pay_get_state(dat_pay_gyro);    //RAM copy, see pay_state_load
 }
 int pay_set_state_gyro(void *param){
     int value = *( (int*)param );
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_gyro_state;
-    mem_setVar(mem_eeprom_var, value);
+    if(pay_set_state(dat_pay_gyro, value) == FALSE){
+        return 0;   //not a 4 bits state, see PAY_STATE_MAX
+    }
+    pay_state_flush();   //a command is saved right away
     return 1;
 }
 int pay_debug_gyro(void *param){
@@ -694,14 +1252,14 @@ int pay_isAlive_tmEstado(void *param){
     return 1;
 }
 int pay_get_state_tmEstado(void *param){
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_tmEstado_state;
-    int res = mem_getVar(mem_eeprom_var);
-    return res;
+    return pay_get_state(dat_pay_tmEstado);    //RAM copy, see pay_state_load
 }
 int pay_set_state_tmEstado(void *param){
     int value = *( (int*)param );
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_tmEstado_state;
-    mem_setVar(mem_eeprom_var, value);
+    if(pay_set_state(dat_pay_tmEstado, value) == FALSE){
+        return 0;   //not a 4 bits state, see PAY_STATE_MAX
+    }
+    pay_state_flush();   //a command is saved right away
     return 1;
 }
 int pay_init_tmEstado(void *param){
@@ -785,14 +1343,14 @@ int pay_isAlive_camera(void *param){
     return cam_isAlive();
 }
 int pay_get_state_camera(void *param){
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_camera_state;
-    int res = mem_getVar(mem_eeprom_var);
-    return res;
+    return pay_get_state(dat_pay_camera);    //RAM copy, see pay_state_load
 }
 int pay_set_state_camera(void *param){
     int value = *( (int*)param );
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_camera_state;
-    mem_setVar(mem_eeprom_var, value);
+    if(pay_set_state(dat_pay_camera, value) == FALSE){
+        return 0;   //not a 4 bits state, see PAY_STATE_MAX
+    }
+    pay_state_flush();   //a command is saved right away
     return 1;
 }
 int pay_init_camera(void *param){
@@ -906,16 +1464,7 @@ BOOL pay_cam_takeAndSave_photo(int resolution, int qual, int pic_type){
         int_r[8] = pay_camera_get_1int_from_2bytes();
         int_r[9] = pay_camera_get_1int_from_2bytes();
 
-        dat_set_Payload_Buff( dat_pay_camera, (int)int_r[0]);
-        dat_set_Payload_Buff( dat_pay_camera, (int)int_r[1]);
-        dat_set_Payload_Buff( dat_pay_camera, (int)int_r[2]);
-        dat_set_Payload_Buff( dat_pay_camera, (int)int_r[3]);
-        dat_set_Payload_Buff( dat_pay_camera, (int)int_r[4]);
-        dat_set_Payload_Buff( dat_pay_camera, (int)int_r[5]);
-        dat_set_Payload_Buff( dat_pay_camera, (int)int_r[6]);
-        dat_set_Payload_Buff( dat_pay_camera, (int)int_r[7]);
-        dat_set_Payload_Buff( dat_pay_camera, (int)int_r[8]);
-        dat_set_Payload_Buff( dat_pay_camera, (int)int_r[9]);
+        pay_set_Payload_Buff_block(dat_pay_camera, int_r, 10);
 
         ClrWdt();
         //printf("      saving [%d/%d] ..\r\n", iter, num_10sections);
@@ -987,14 +1536,14 @@ int pay_isAlive_gps(void *param){
     return 0;
 }
 int pay_get_state_gps(void *param){
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_gps_state;
-    int res = mem_getVar(mem_eeprom_var);
-    return res;
+    return pay_get_state(dat_pay_gps);    //RAM copy, see pay_state_load
 }
 int pay_set_state_gps(void *param){
     int value = *( (int*)param );
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_gps_state;
-    mem_setVar(mem_eeprom_var, value);
+    if(pay_set_state(dat_pay_gps, value) == FALSE){
+        return 0;   //not a 4 bits state, see PAY_STATE_MAX
+    }
+    pay_state_flush();   //a command is saved right away
     return 1;
 }
 int pay_init_gps(void *param){
@@ -1216,14 +1765,14 @@ int pay_isAlive_langmuirProbe(void *param){
     return langmuir_isAlive();
 }
 int pay_get_state_langmuirProbe(void *param){
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_langmuirProbe_state;
-    int res = mem_getVar(mem_eeprom_var);
-    return res;
+    return pay_get_state(dat_pay_langmuirProbe);    //RAM copy, see pay_state_load
 }
 int pay_set_state_langmuirProbe(void *param){
     int value = *( (int*)param );
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_langmuirProbe_state;
-    mem_setVar(mem_eeprom_var, value);
+    if(pay_set_state(dat_pay_langmuirProbe, value) == FALSE){
+        return 0;   //not a 4 bits state, see PAY_STATE_MAX
+    }
+    pay_state_flush();   //a command is saved right away
     return 1;
 }
 
@@ -1437,14 +1986,14 @@ int pay_isAlive_sensTemp(void *param){
     return rest;
 }
 int pay_get_state_sensTemp(void *param){
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_sensTemp_state;
-    int res = mem_getVar(mem_eeprom_var);
-    return res;
+    return pay_get_state(dat_pay_sensTemp);    //RAM copy, see pay_state_load
 }
 int pay_set_state_sensTemp(void *param){
     int value = *( (int*)param );
-    MemEEPROM_Vars mem_eeprom_var = mem_pay_sensTemp_state;
-    mem_setVar(mem_eeprom_var, value);
+    if(pay_set_state(dat_pay_sensTemp, value) == FALSE){
+        return 0;   //not a 4 bits state, see PAY_STATE_MAX
+    }
+    pay_state_flush();   //a command is saved right away
     return 1;
 }
 int pay_init_sensTemp(void *param){
@@ -1540,7 +2089,7 @@ void pay_fp2_multiplexed(){
         printf("pay_fp2_i_multiplexing => pay_i = %d\r\n", (unsigned int)current_pay_i);
     #endif
 
-    PAY_xxx_State pay_i_state = sta_get_BusStateVar(sta_DAT_Payload_Buff_to_STA_PayStateVar(current_pay_i));
+    PAY_xxx_State pay_i_state = pay_get_state(current_pay_i);    //RAM copy, MemEEPROM lags behind
     switch(pay_i_state){
         case pay_xxx_state_inactive:
             printf("  pay_i = %s", dat_get_payload_name(current_pay_i));
@@ -1602,10 +2151,15 @@ void pay_fp2_multiplexed(){
 void pay_fp2_simultaneous(void)
 {
     //reviso payloads "simultaneamente" y ejecuto en multiplos de cada llamada reentrante
-    static long unsigned int exec_tick;
-    exec_tick++;
+    pay_fp2_tick++;
     static unsigned int run_take_times_executed[dat_pay_last_one];    //all initialized to zero
 
+    //dispatches the next entry of the expFis sweep plan, if one is due
+    pay_sweep_tick();
+
+    //no payload due in this tick
+    if(pay_fp2_tick < pay_fp2_next_due){ return; }
+
     DAT_Payload_Buff pay_i;
     PAY_xxx_State pay_i_state;
     int pay_i_tick_rate;
@@ -1619,18 +2173,17 @@ void pay_fp2_simultaneous(void)
     for(pay_i = 0; pay_i < dat_pay_last_one; pay_i++)
     {
         //continue if it's no time for pay_i yet
+        if(pay_fp2_tick < pay_fp2_next_tick[pay_i]){continue;}
         pay_i_tick_rate = pay_fp2_get_exec_rate(pay_i);
-        if( exec_tick%pay_i_tick_rate != 0 ){continue;}
-        
+        pay_fp2_next_tick[pay_i] = pay_fp2_tick + pay_i_tick_rate;
 
         #if (SCH_TFLIGHTPLAN2_VERBOSE>=1)
             printf("  pay_i = %d = %s \r\n", pay_i, dat_get_payload_name(pay_i) );
-            printf("  exec_tick = %lu \r\n", exec_tick);
+            printf("  exec_tick = %lu \r\n", pay_fp2_tick);
             printf("  pay_i_tick_rate = %d \r\n", pay_i_tick_rate);
         #endif
 
-        STA_PayStateVar pay_i_state_var = sta_DAT_Payload_Buff_to_STA_PayStateVar(pay_i);
-        pay_i_state = sta_get_PayStateVar(pay_i_state_var);
+        pay_i_state = pay_get_state(pay_i);    //RAM copy, no MemEEPROM access
         switch(pay_i_state){
         //**********************************************************************
             case pay_xxx_state_inactive:
@@ -1727,7 +2280,10 @@ void pay_fp2_simultaneous(void)
         #endif
 
     }
+    pay_fp2_update_next_due();
     
+    pay_state_flush();  //the transitions of this tick, in one batch
+
     #if (SCH_TFLIGHTPLAN2_VERBOSE>=1)
         //print time
         rtc_print(NULL);
@@ -1740,99 +2296,50 @@ void pay_fp2_simultaneous(void)
  * @return Return the number of ticks before a pay_i is executed
  */
 int pay_fp2_get_exec_rate(DAT_Payload_Buff pay_i){
-
-    /* Se asume que hay un tick cada 10[sec]
-     * Por lo tanto un tick de 6 => exec cada 60sec
-     */
-
-    switch(pay_i){
-        case dat_pay_tmEstado:
-            return 6;       //tick_rate in taskHousekeeping is 10sec => every 60 sec = 1min
-            break;
-        case dat_pay_battery:
-            return 6;       //tick_rate in taskHousekeeping is 10sec => every 60 sec = 1min
-            break;
-        case dat_pay_debug:
-            return 6;       //tick_rate in taskHousekeeping is 10sec => every 60 sec = 1min
-            break;
-        case dat_pay_langmuirProbe:
-            return 6;       //tick_rate in taskHousekeeping is 10sec => every 60 sec = 1min
-            break;
-        case dat_pay_gps:
-            return 6;       //tick_rate in taskHousekeeping is 10sec => every 60 sec = 1min
-            break;
-        case dat_pay_camera:
-            return 6;       //tick_rate in taskHousekeeping is 10sec => every 60 sec = 1min
-            break;
-        case dat_pay_sensTemp:
-            return 6;       //tick_rate in taskHousekeeping is 10sec => every 60 sec = 1min
-            break;
-        case dat_pay_gyro:
-            return 6;       //tick_rate in taskHousekeeping is 10sec => every 60 sec = 1min
-            break;
-        case dat_pay_expFis:
-            return 6;       //tick_rate in taskHousekeeping is 10sec => every 60 sec = 1min
-            break;
-        case dat_pay_last_one:
-            //ignore
-            break;
-    }
-    return -1;
+    if(pay_i >= dat_pay_last_one){ return -1; }
+    return pay_fp2_exec_rate[pay_i];
 }
 
 /**
  * Return the number of times pay_i is to be executed
  * @param pay_i
- * @return Return TRUE = isDOne, FLASE = contiune pay_take
+ * @return Number of pay_take before pay_stop
  */
 unsigned int pay_fp2_get_run_take_num_exec_times(DAT_Payload_Buff pay_i){
-    unsigned int max_exec_times;
-
-    /* Se asume que hay un tick cada 1[min]
-     * 
-     * Luego:
-     * 1) Con 95 min completo una orbita
-     * 2) Si una "vuelta al mundo" dura 24*60 = 1440[min]
-     * Si cada orbita dura 95[min] => 1440/95 = 15.1578947 [orbitas/vuelta al mundo]
-     * Por lo tanto con aproximadamente 16 orbitas doy "la vuelta al mundo"
-     */
-    unsigned int pay_exec_times = 95*2;
-    //unsigned int pay_exec_times = 95*16;
-    //unsigned int pay_exec_times = 1440 + 20;
-    switch(pay_i){
-        case dat_pay_tmEstado:
-            max_exec_times = pay_exec_times;    // if tick is 1 min => 1 orbit of 95 min => 95 execution_times
-            break;
-        case dat_pay_battery:
-            max_exec_times = pay_exec_times;    // if tick is 1 min => 1 orbit of 95 min => 95 execution_times
-            break;
-        case dat_pay_debug:
-            max_exec_times = pay_exec_times;    // if tick is 1 min => 1 orbit of 95 min => 95 execution_times
-            break;
-        case dat_pay_langmuirProbe:
-            max_exec_times = pay_exec_times;    // if tick is 1 min => 1 orbit of 95 min => 95 execution_times
-            break;
-        case dat_pay_gps:
-            max_exec_times = pay_exec_times;    // if tick is 1 min => 1 orbit of 95 min => 95 execution_times
-            break;
-        case dat_pay_camera:
-            max_exec_times = pay_exec_times;    // if tick is 1 min => 1 orbit of 95 min => 95 execution_times
-            break;
-        case dat_pay_sensTemp:
-            max_exec_times = pay_exec_times;    // if tick is 1 min => 1 orbit of 95 min => 95 execution_times
-            break;
-        case dat_pay_gyro:
-            max_exec_times = pay_exec_times;    // if tick is 1 min => 1 orbit of 95 min => 95 execution_times
-            break;
-        case dat_pay_expFis:
-            max_exec_times = pay_exec_times;    // if tick is 1 min => 1 orbit of 95 min => 95 execution_times
-            break;
-        default:
-            //ignore
-            max_exec_times = 0;
-            break;
-    }
-    return max_exec_times;
+    if(pay_i >= dat_pay_last_one){ return 0; }
+    return pay_fp2_take_times[pay_i];
+}
+
+/**
+ * Changes how often the FP2 runs a payload, until the next reset
+ * @param param bits 12-15 pay_i (DAT_Payload_Buff), bits 0-11 FP2 ticks
+ * between runs (at least 1)
+ * @return 1 if success, 0 if pay_i or the rate are invalid
+ */
+int pay_fp2_set_rate(void *param){
+    unsigned int conf = *((unsigned int *) param);
+    unsigned int pay_i = conf >> 12;
+    unsigned int rate = conf & 0x0FFF;
+    if(pay_i >= dat_pay_last_one || rate == 0){ return 0; }
+    pay_fp2_exec_rate[pay_i] = rate;
+    //the new period counts from now
+    pay_fp2_next_tick[pay_i] = pay_fp2_tick + rate;
+    pay_fp2_update_next_due();
+    return 1;
+}
+
+/**
+ * Changes how many times the FP2 runs pay_take before pay_stop, until the
+ * next reset
+ * @param param bits 12-15 pay_i (DAT_Payload_Buff), bits 0-11 number of takes
+ * @return 1 if success, 0 if pay_i is invalid
+ */
+int pay_fp2_set_take_times(void *param){
+    unsigned int conf = *((unsigned int *) param);
+    unsigned int pay_i = conf >> 12;
+    if(pay_i >= dat_pay_last_one){ return 0; }
+    pay_fp2_take_times[pay_i] = conf & 0x0FFF;
+    return 1;
 }
 
 /**
@@ -1841,272 +2348,171 @@ unsigned int pay_fp2_get_run_take_num_exec_times(DAT_Payload_Buff pay_i){
  * @param run_state
  */
 void pay_fp2_exec_run_xxx(DAT_Payload_Buff pay_i, PAY_xxx_State state){
-    int arg;
-    switch(pay_i){
-        case dat_pay_tmEstado:
-            switch (state){
-                case pay_xxx_state_run_init:
-                    arg = 0;
-                    pay_init_tmEstado(&arg);
-                    break;
-                case pay_xxx_state_run_take:
-                    arg = 1;
-                    pay_take_tmEstado(&arg);
-                    break;
-                case pay_xxx_state_run_stop:
-                    pay_stop_tmEstado(&arg);
-                    break;
-                //ignore the rest of states
-                case pay_xxx_state_active:
-                case pay_xxx_state_inactive:
-                case pay_xxx_state_waiting_tx:
-                    break;
-            }
-            break;
-        case dat_pay_battery:
-            switch (state){
-                case pay_xxx_state_run_init:
-                    arg = 0;
-                    pay_init_battery(&arg);
-                    break;
-                case pay_xxx_state_run_take:
-                    pay_take_battery(&arg);
-                    break;
-                case pay_xxx_state_run_stop:
-                    pay_stop_battery(&arg);
-                    break;
-                //ignore the rest of states
-                case pay_xxx_state_active:
-                case pay_xxx_state_inactive:
-                case pay_xxx_state_waiting_tx:
-                    break;
-            }
-            break;
-        case dat_pay_debug:
-            switch (state){
-                case pay_xxx_state_run_init:
-                    arg = 0;
-                    pay_init_debug(&arg);
-                    break;
-                case pay_xxx_state_run_take:
-                    pay_take_debug(&arg);
-                    break;
-                case pay_xxx_state_run_stop:
-                    pay_stop_debug(&arg);
-                    break;
-                //ignore the rest of states
-                case pay_xxx_state_active:
-                case pay_xxx_state_inactive:
-                case pay_xxx_state_waiting_tx:
-                    break;
-            }
-            break;
-        case dat_pay_langmuirProbe:
-            switch (state){
-                case pay_xxx_state_run_init:
-                    arg = 0;
-                    pay_init_langmuirProbe(&arg);
-                    break;
-                case pay_xxx_state_run_take:
-                    pay_take_langmuirProbe(&arg);
-                    break;
-                case pay_xxx_state_run_stop:
-                    pay_stop_langmuirProbe(&arg);
-                    break;
-                //ignore the rest of states
-                case pay_xxx_state_active:
-                case pay_xxx_state_inactive:
-                case pay_xxx_state_waiting_tx:
-                    break;
-            }
-            break;
-        case dat_pay_gps:
-            switch (state){
-                case pay_xxx_state_run_init:
-                    arg = 0;
-                    pay_init_gps(&arg);
-                    break;
-                case pay_xxx_state_run_take:
-                    arg = 25;   //gps_cmdnum => RMC nmea sentence
-                    pay_take_gps(&arg);
-                    break;
-                case pay_xxx_state_run_stop:
-                    pay_stop_gps(&arg);
-                    break;
-                //ignore the rest of states
-                case pay_xxx_state_active:
-                case pay_xxx_state_inactive:
-                case pay_xxx_state_waiting_tx:
-                    break;
-            }
-            break;
-        case dat_pay_camera:
-            switch (state){
-                case pay_xxx_state_run_init:
-                    arg = 0;
-                    pay_init_camera(&arg);
-                    break;
-                case pay_xxx_state_run_take:
-                    pay_take_camera(&arg);
-                    break;
-                case pay_xxx_state_run_stop:
-                    pay_stop_camera(&arg);
-                    break;
-                //ignore the rest of states
-                case pay_xxx_state_active:
-                case pay_xxx_state_inactive:
-                case pay_xxx_state_waiting_tx:
-                    break;
-            }
+    const PAY_Descriptor *d;
+    int arg = 0;
+    pay_state_flush();  //a reset inside the command resumes from the saved state
+    if(pay_i >= dat_pay_last_one){ return; }
+    d = &pay_table[pay_i];
+    switch (state){
+        case pay_xxx_state_run_init:
+            d->init(&arg);
             break;
-        case dat_pay_sensTemp:
-            switch (state){
-                case pay_xxx_state_run_init:
-                    arg = 0;
-                    pay_init_sensTemp(&arg);
-                    break;
-                case pay_xxx_state_run_take:
-                    pay_take_sensTemp(&arg);
-                    break;
-                case pay_xxx_state_run_stop:
-                    pay_stop_sensTemp(&arg);
-                    break;
-                //ignore the rest of states
-                case pay_xxx_state_active:
-                case pay_xxx_state_inactive:
-                case pay_xxx_state_waiting_tx:
-                    break;
-            }
+        case pay_xxx_state_run_take:
+            arg = d->take_arg;
+            d->take(&arg);
             break;
-        case dat_pay_gyro:
-            switch (state){
-                case pay_xxx_state_run_init:
-                    arg = 0;
-                    pay_init_gyro(&arg);
-                    break;
-                case pay_xxx_state_run_take:
-                    pay_take_gyro(&arg);
-                    break;
-                case pay_xxx_state_run_stop:
-                    pay_stop_gyro(&arg);
-                    break;
-                //ignore the rest of states
-                case pay_xxx_state_active:
-                case pay_xxx_state_inactive:
-                case pay_xxx_state_waiting_tx:
-                    break;
-            }
+        case pay_xxx_state_run_stop:
+            d->stop(&arg);
             break;
-        case dat_pay_expFis:
-            switch (state){
-                case pay_xxx_state_run_init:
-                    arg = 0;
-                    pay_init_expFis(&arg);
-                    break;
-                case pay_xxx_state_run_take:
-                    pay_take_expFis(&arg);
-                    break;
-                case pay_xxx_state_run_stop:
-                    pay_stop_expFis(&arg);
-                    break;
-                //ignore the rest of states
-                case pay_xxx_state_active:
-                case pay_xxx_state_inactive:
-                case pay_xxx_state_waiting_tx:
-                    break;
-            }
+        //ignore the rest of states
+        case pay_xxx_state_active:
+        case pay_xxx_state_inactive:
+        case pay_xxx_state_waiting_tx:
             break;
-        case dat_pay_last_one:
-            //ignore
+    }
+}
+
+/*
+ * RAM copy of the FSM state of every payload. The FP2 reads it every tick
+ * and the transitions are written back to MemEEPROM by pay_state_flush, as
+ * records of a PAY_STATE_LOG_LEN slots log, so each slot and each
+ * mem_pay_xxx_state variable is written once every PAY_STATE_LOG_LEN
+ * transitions instead of at every one of them
+ */
+static int pay_state_cache[dat_pay_last_one];
+static int pay_state_logged[dat_pay_last_one]; //value after replaying the log (or the checkpoint)
+static int pay_state_saved[dat_pay_last_one];  //value of the mem_pay_xxx_state variable
+static unsigned int pay_state_dirty = 0;    //mask of payloads changed since the last flush
+static BOOL pay_state_loaded = FALSE;
+static unsigned int pay_state_log_head;     //next slot of the log
+static unsigned int pay_state_log_seq;      //sequence number of the next record
+
+/*
+ * Loads the states at the last checkpoint and replays the transitions logged
+ * after it. The records after a checkpoint fill the log from slot 0 with
+ * consecutive sequence numbers from mem_pay_state_log_seq on, so the first
+ * slot out of sequence is the end of the log
+ */
+static void pay_state_load(void){
+    DAT_Payload_Buff pay_i;
+    unsigned int j, w, base;
+
+    for(pay_i = 0; pay_i < dat_pay_last_one; pay_i++){
+        pay_state_saved[pay_i] = mem_getVar(pay_table[pay_i].mem_state);
+        pay_state_cache[pay_i] = pay_state_saved[pay_i];
+    }
+    base = (unsigned int)mem_getVar(mem_pay_state_log_seq) & 0x00FF;
+    for(j = 0; j < PAY_STATE_LOG_LEN; j++){
+        w = (unsigned int)mem_getVar((MemEEPROM_Vars)(mem_pay_state_log + j));
+        if((w & 0x00FF) != ((base + j) & 0x00FF) || (w >> 12) == 0 || (w >> 12) > dat_pay_last_one){
             break;
+        }
+        pay_state_cache[(w >> 12) - 1] = (w >> 8) & 0x000F;
+    }
+    for(pay_i = 0; pay_i < dat_pay_last_one; pay_i++){
+        pay_state_logged[pay_i] = pay_state_cache[pay_i];
+    }
+    pay_state_log_head = j;
+    pay_state_log_seq = (base + j) & 0x00FF;
+    pay_state_dirty = 0;
+    pay_state_loaded = TRUE;
+
+    #if (SCH_TFLIGHTPLAN2_VERBOSE>=1)
+        printf("[pay_state_load] %u transitions replayed\r\n", j);
+    #endif
+}
+
+/*
+ * Writes the logged states into their mem_pay_xxx_state variables and starts
+ * a new log, from slot 0 and the next sequence number. Only states already in
+ * the log are written: a reset before the new sequence number is saved
+ * replays the full log over them and ends in the same states
+ */
+static void pay_state_checkpoint(void){
+    DAT_Payload_Buff pay_i;
+    for(pay_i = 0; pay_i < dat_pay_last_one; pay_i++){
+        if(pay_state_logged[pay_i] != pay_state_saved[pay_i]){
+            mem_setVar(pay_table[pay_i].mem_state, pay_state_logged[pay_i]);
+            pay_state_saved[pay_i] = pay_state_logged[pay_i];
+        }
     }
+    //the old records are only ignored once the states are saved
+    mem_setVar(mem_pay_state_log_seq, pay_state_log_seq);
+    pay_state_log_head = 0;
 }
 
 /**
- * Get pay_i execution state
+ * Writes the state changes kept in RAM back to MemEEPROM, one log record per
+ * payload changed. Called before any payload command runs and at the end of
+ * each FP2 tick, so the transitions survive a reset in the middle of a command
+ */
+void pay_state_flush(void){
+    DAT_Payload_Buff pay_i;
+    unsigned int w;
+
+    if(pay_state_dirty == 0){ return; }
+    for(pay_i = 0; pay_i < dat_pay_last_one; pay_i++){
+        if((pay_state_dirty & (1 << pay_i)) == 0){ continue; }
+        w = ((pay_i + 1) << 12) | (((unsigned int)pay_state_cache[pay_i]) << 8) | pay_state_log_seq;
+        mem_setVar((MemEEPROM_Vars)(mem_pay_state_log + pay_state_log_head), (int)w);
+        pay_state_logged[pay_i] = pay_state_cache[pay_i];
+        pay_state_log_head++;
+        pay_state_log_seq = (pay_state_log_seq + 1) & 0x00FF;
+        if(pay_state_log_head == PAY_STATE_LOG_LEN){
+            pay_state_checkpoint();     //log full, the transition that filled it is already in
+        }
+    }
+    pay_state_dirty = 0;
+}
+
+/**
+ * Get pay_i execution state, from the RAM copy
  * @param pay_i
- * @param state
+ * @return state, -1 for dat_pay_last_one
  */
 PAY_xxx_State pay_get_state(DAT_Payload_Buff pay_i){
-    PAY_xxx_State pay_i_state;
-    switch(pay_i){
-        case dat_pay_tmEstado:
-            pay_i_state = pay_get_state_tmEstado(NULL);
-            break;
-        case dat_pay_battery:
-            pay_i_state = pay_get_state_battery(NULL);
-            break;
-        case dat_pay_debug:
-            pay_i_state = pay_get_state_debug(NULL);
-            break;
-        case dat_pay_langmuirProbe:
-            pay_i_state = pay_get_state_langmuirProbe(NULL);
-            break;
-        case dat_pay_gps:
-            pay_i_state = pay_get_state_gps(NULL);
-            break;
-        case dat_pay_camera:
-            pay_i_state = pay_get_state_camera(NULL);
-            break;
-        case dat_pay_sensTemp:
-            pay_i_state = pay_get_state_sensTemp(NULL);
-            break;
-        case dat_pay_gyro:
-            pay_i_state = pay_get_state_gyro(NULL);
-            break;
-        case dat_pay_expFis:
-            pay_i_state = pay_get_state_expFis(NULL);
-            break;
-        case dat_pay_last_one:
-            //ignore
-            pay_i_state = -1;
-            break;
-    }
-    return pay_i_state;
+    if(pay_i >= dat_pay_last_one){ return -1; }
+    if(pay_state_loaded == FALSE){ pay_state_load(); }
+    return pay_state_cache[pay_i];
 }
 
 /**
- * Set the state of pay_i. Used to control execution, by FP2 and others
+ * Set the state of pay_i. Used to control execution, by FP2 and others.
+ * Only the RAM copy is changed, see pay_state_flush
  * @param pay_i
- * @param state
+ * @param state 0 to PAY_STATE_MAX, the states that fit a log record
+ * @return FALSE if pay_i or state is out of range (state unchanged)
  */
-void pay_set_state(DAT_Payload_Buff pay_i, PAY_xxx_State state){
-    //change state
-    int arg_state = state;
-    switch(pay_i){
-        case dat_pay_tmEstado:
-            pay_set_state_tmEstado(&arg_state);
-            break;
-        case dat_pay_battery:
-            pay_set_state_battery(&arg_state);
-            break;
-        case dat_pay_debug:
-            pay_set_state_debug(&arg_state);
-            break;
-        case dat_pay_langmuirProbe:
-            pay_set_state_langmuirProbe(&arg_state);
-            break;
-        case dat_pay_gps:
-            pay_set_state_gps(&arg_state);
-            break;
-        case dat_pay_camera:
-            pay_set_state_camera(&arg_state);
-            break;
-        case dat_pay_sensTemp:
-            pay_set_state_sensTemp(&arg_state);
-            break;
-        case dat_pay_gyro:
-            pay_set_state_gyro(&arg_state);
-            break;
-        case dat_pay_expFis:
-            pay_set_state_expFis(&arg_state);
-            break;
-        case dat_pay_last_one:
-            //ignore
-//            state = state;
-            break;
+BOOL pay_set_state(DAT_Payload_Buff pay_i, PAY_xxx_State state){
+    if(pay_i >= dat_pay_last_one){ return FALSE; }
+    if((unsigned int)state > PAY_STATE_MAX){
+        printf("[pay_set_state] invalid state %d, at most %d\r\n", (int)state, PAY_STATE_MAX);
+        return FALSE;
     }
+    if(pay_state_loaded == FALSE){ pay_state_load(); }
+    if(pay_state_cache[pay_i] == (int)state){ return TRUE; }
+    pay_state_cache[pay_i] = state;
+    pay_state_dirty |= (1 << pay_i);
+    return TRUE;
+}
 
+/**
+ * Saves a block of values into the Data Repository of pay_i, in order.
+ * The values are read straight from src, so the caller does not need to copy
+ * them first. Stops at the first value the repository rejects (full)
+ * @param pay_i Payload buffer
+ * @param src Values to save
+ * @param n Number of values in src
+ * @return Number of values saved
+ */
+unsigned int pay_set_Payload_Buff_block(DAT_Payload_Buff pay_i, const unsigned int *src, unsigned int n){
+    unsigned int i;
+    for(i = 0; i < n; i++){
+        if(dat_set_Payload_Buff(pay_i, (int)src[i]) == FALSE){
+            break;
+        }
+    }
+    return i;
 }
 
 /**
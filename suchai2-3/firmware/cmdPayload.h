@@ -22,6 +22,9 @@
 //payloads
 #include "langmuir.h"
 #include "fis_payload.h"
+#include "fis_stats.h"
+#include "fis_comp.h"
+#include "fis_reduce.h"
 #include "camera.h"
 #include "dig_gyro.h"
 #include "sensTemp.h"
@@ -130,6 +133,25 @@ typedef enum{
     pay_id_stop_langmuirProbe, ///< @cmd
     pay_id_send_to_langmuirProbe, ///< @cmd      //Ox6046
     pay_id_adhoc_langmuirProbe, ///< @cmd   69 <=> Ox6047
+
+    pay_id_set_adcMode_expFis, //< @cmd       //0x6048
+    pay_id_set_output_expFis, //< @cmd        //0x6049
+    pay_id_set_hist_expFis, //< @cmd          //0x604A
+    pay_id_set_waveform_expFis, //< @cmd      //0x604B
+    pay_id_sweep_clear_expFis, //< @cmd       //0x604C
+    pay_id_sweep_add_expFis, //< @cmd         //0x604D
+    pay_id_sweep_run_expFis, //< @cmd         //0x604E
+    pay_id_set_timing_expFis, //< @cmd        //0x604F
+    pay_id_set_stamps_expFis, //< @cmd        //0x6050
+    pay_id_stats_expFis, //< @cmd             //0x6051
+    pay_id_set_geometry_expFis, //< @cmd      //0x6052
+    pay_id_set_profile_expFis, //< @cmd       //0x6053
+    pay_id_set_reduce_expFis, //< @cmd        //0x6054
+    pay_id_set_settle_expFis, //< @cmd        //0x6055
+    pay_id_fp2_set_rate, //< @cmd             //0x6056
+    pay_id_fp2_set_take_times, //< @cmd       //0x6057
+    pay_id_commit_geometry_expFis, //< @cmd   //0x6058
+    pay_id_sweep_entry_expFis, //< @cmd       //0x6059
             
     //*********************
     pay_id_last_one    //Elemento sin sentido, solo se utiliza para marcar el largo del arreglo
@@ -137,6 +159,32 @@ typedef enum{
 
 #define PAY_NCMD ((unsigned char)pay_id_last_one)
 
+/*
+ * expFis sweep plan, kept in MemEEPROM from mem_pay_expFis_sweep_plan on.
+ * Each entry is FIS_SWEEP_ENTRY_LEN words: adcPeriod, seed, rounds and
+ * mode = adcMode | (waveform << 4) | (output << 8)
+ */
+#define FIS_SWEEP_MAX_ENTRIES (32)
+#define FIS_SWEEP_ENTRY_LEN (4)
+//times an entry is started (resets in the middle included) before skipping it
+#define FIS_SWEEP_MAX_ATTEMPTS (3)
+//mem_pay_expFis_sweep_idx = FIS_SWEEP_ACTIVE | attempts << 8 | entry index
+#define FIS_SWEEP_ACTIVE (0x8000)
+//FP2 ticks before an entry dispatched but never started is dispatched again
+#define FIS_SWEEP_RETRY_TICKS (6)
+
+/*
+ * Log of payload FSM transitions, kept in MemEEPROM from mem_pay_state_log on
+ * (see pay_state_flush). Each slot is (pay_i+1) << 12 | state << 8 | seq and
+ * mem_pay_state_log_seq holds the seq of slot 0 since the last checkpoint.
+ * A state has 4 bits in a slot, so pay_set_state and the pay_set_state_xxx
+ * commands reject (return 0) any state above PAY_STATE_MAX. The
+ * mem_pay_xxx_state variables and the STA payload state vars are only
+ * updated at checkpoints, read the current state with pay_get_state
+ */
+#define PAY_STATE_LOG_LEN (32)
+#define PAY_STATE_MAX (0x000F)
+
 
 void pay_onResetCmdPAY(void);
 
@@ -158,6 +206,26 @@ typedef enum{
     pay_xxx_state_waiting_tx
 }PAY_xxx_State;
 
+/*
+ * Payload registry, one row per DAT_Payload_Buff (see pay_table). The six
+ * standard commands of a payload are consecutive in PAY_CmdIndx from
+ * id_isAlive on: isAlive, get_state, set_state, init, take and stop
+ */
+typedef struct{
+    PAY_CmdIndx id_isAlive;
+    cmdFunction isAlive;
+    cmdFunction get_state;
+    cmdFunction set_state;
+    cmdFunction init;
+    cmdFunction take;
+    cmdFunction stop;
+    MemEEPROM_Vars mem_state;   //FSM state of the payload
+    int sys_req;                //of isAlive, init, take and stop
+    int take_arg;               //param of take in the FP2
+    unsigned int exec_rate;     //FP2 ticks between runs
+    unsigned int take_times;    //FP2 takes before stop
+}PAY_Descriptor;
+
 //Comandos
 //Debug
 int pay_test_dataRepo(void *param);
@@ -188,6 +256,22 @@ int pay_stop_expFis(void *param);
 int pay_adhoc_expFis(void *param);
 int pay_set_seed_expFis(void *param);
 int pay_set_adcPeriod_expFis(void *param);
+int pay_set_adcMode_expFis(void *param);
+int pay_set_output_expFis(void *param);
+int pay_set_hist_expFis(void *param);
+int pay_set_waveform_expFis(void *param);
+int pay_sweep_clear_expFis(void *param);
+int pay_sweep_add_expFis(void *param);
+int pay_sweep_run_expFis(void *param);
+int pay_sweep_entry_expFis(void *param);
+int pay_set_timing_expFis(void *param);
+int pay_set_stamps_expFis(void *param);
+int pay_stats_expFis(void *param);
+int pay_set_geometry_expFis(void *param);
+int pay_commit_geometry_expFis(void *param);
+int pay_set_profile_expFis(void *param);
+int pay_set_reduce_expFis(void *param);
+int pay_set_settle_expFis(void *param);
 int pay_testFreq_expFis(void *param);
 int pay_testDAC_expFis(void *param);
 int pay_print_seed(void* param);
@@ -252,15 +336,21 @@ int pay_gps_jsat(void *param);
 BOOL pay_cam_takeAndSave_photo(int resolution, int qual, int pic_type);
 int pay_camera_get_1int_from_2bytes(void);
 void pay_save_date_time_to_Payload_Buff(DAT_Payload_Buff pay_i);
+unsigned int pay_set_Payload_Buff_block(DAT_Payload_Buff pay_i, const unsigned int *src, unsigned int n);
+unsigned int pay_sweep_pending(void);
+BOOL pay_sweep_tick(void);
 
 //FP2
 void pay_fp2_multiplexed(void);
 void pay_fp2_simultaneous(void);
 int pay_fp2_get_exec_rate(DAT_Payload_Buff pay_i);
 unsigned int pay_fp2_get_run_take_num_exec_times(DAT_Payload_Buff pay_i);
+int pay_fp2_set_rate(void *param);
+int pay_fp2_set_take_times(void *param);
 void pay_fp2_exec_run_xxx(DAT_Payload_Buff pay_i, PAY_xxx_State state);
-void pay_set_state(DAT_Payload_Buff pay_i, PAY_xxx_State state);
+BOOL pay_set_state(DAT_Payload_Buff pay_i, PAY_xxx_State state);
 PAY_xxx_State pay_get_state(DAT_Payload_Buff pay_i);
+void pay_state_flush(void);
 
 #endif	/* CMDPAYLOAD_H */
 
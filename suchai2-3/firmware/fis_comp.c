@@ -0,0 +1,115 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2013, Tomas Opazo Toro, tomas.opazo.t@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fis_comp.h"
+
+/*
+ * Bit writer, packs MSB first into 16 bits words
+ */
+typedef struct{
+    unsigned int *dst;      //output words
+    unsigned int len;       //words written
+    unsigned int max;       //words available
+    unsigned long acc;      //pending bits, right aligned
+    unsigned int nbits;     //number of pending bits
+} FIS_BitWriter;
+
+static BOOL fis_comp_put_bits(FIS_BitWriter *w, unsigned int value, unsigned int nbits){
+    w->acc = (w->acc << nbits) | ((unsigned long)value & ((1UL << nbits) - 1));
+    w->nbits += nbits;
+    while(w->nbits >= 16){
+        if(w->len >= w->max){ return FALSE; }
+        w->nbits -= 16;
+        w->dst[w->len++] = (unsigned int)((w->acc >> w->nbits) & 0xFFFF);
+    }
+    return TRUE;
+}
+
+static BOOL fis_comp_flush(FIS_BitWriter *w){
+    if(w->nbits > 0){
+        return fis_comp_put_bits(w, 0, 16 - w->nbits);
+    }
+    return TRUE;
+}
+
+static unsigned int fis_comp_zigzag(int d){
+    return (d >= 0)? ((unsigned int)d << 1) : (((unsigned int)(-d) << 1) - 1);
+}
+
+/*
+ * Rice parameter from the mean of the mapped deltas, k ~ log2(mean)
+ */
+static unsigned int fis_comp_choose_k(const unsigned int *src, unsigned int n){
+    unsigned int i, k;
+    unsigned long sum = 0;
+    for(i = 1; i < n; i++){
+        sum += fis_comp_zigzag((int)src[i] - (int)src[i-1]);
+    }
+    for(k = 0; k < (FIS_COMP_ESC_BITS - 1) && ((unsigned long)(n-1) << (k+1)) <= sum; k++);
+    return k;
+}
+
+static unsigned int fis_comp_raw(const unsigned int *src, unsigned int n, unsigned int *dst){
+    unsigned int i;
+    dst[0] = (FIS_COMP_RAW_K << 12) | n;
+    for(i = 0; i < n; i++){
+        dst[i+1] = src[i];
+    }
+    return n + 1;
+}
+
+unsigned int fis_comp_encode(const unsigned int *src, unsigned int n, unsigned int *dst){
+    unsigned int i, k, u, q;
+    FIS_BitWriter w;
+
+    if(n == 0 || n > FIS_COMP_MAX_SAMPLES){ return 0; }
+    if(n < 4){ return fis_comp_raw(src, n, dst); }
+    for(i = 0; i < n; i++){
+        if(src[i] > 0x03FF){ return fis_comp_raw(src, n, dst); }  //not a 10 bits sample
+    }
+
+    k = fis_comp_choose_k(src, n);
+    w.dst = &dst[3];
+    w.len = 0;
+    w.max = n - 2;      //a coded block must be smaller than the raw one (n+1 words)
+    w.acc = 0;
+    w.nbits = 0;
+
+    for(i = 1; i < n; i++){
+        u = fis_comp_zigzag((int)src[i] - (int)src[i-1]);
+        q = u >> k;
+        if(q >= FIS_COMP_ESC_Q){
+            if(!fis_comp_put_bits(&w, 0xFFFF, FIS_COMP_ESC_Q)){ break; }
+            if(!fis_comp_put_bits(&w, u, FIS_COMP_ESC_BITS)){ break; }
+        }
+        else{
+            //q ones and a zero
+            if(!fis_comp_put_bits(&w, (unsigned int)((1UL << (q+1)) - 2), q+1)){ break; }
+            if(k > 0 && !fis_comp_put_bits(&w, u, k)){ break; }
+        }
+    }
+    if(i < n || !fis_comp_flush(&w)){
+        return fis_comp_raw(src, n, dst);
+    }
+
+    dst[0] = (k << 12) | n;
+    dst[1] = src[0];
+    dst[2] = w.len;
+    return w.len + 3;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file  fis_comp.h
+ * @copyright GNU Public License.
+ *
+ * Compresion sin perdidas de las muestras del expFis antes de guardarlas en
+ * el repositorio de datos. Cada sens_buff se codifica como un bloque
+ * independiente: primera diferencia, mapeo zigzag y codigo Rice con un
+ * parametro k elegido por bloque. El decodificador en tierra es
+ * suchai1/matlab/fisRiceDecode.m
+ *
+ * Formato de un bloque (palabras de 16 bits):
+ * | word | content                                                 |
+ * | 0    | (k << 12) | n, n = number of samples (max 4095)         |
+ * | 1    | first sample                                            |
+ * | 2    | m = number of bitstream words that follow               |
+ * | 3-   | m words of bitstream, MSB first                         |
+ *
+ * If k == FIS_COMP_RAW_K words 1..n are the raw samples (no word 2). This is
+ * used when the coded block would not be smaller than the raw one. A word
+ * with k == 13 before a block is the FIS_SETTLE_MARK of fis_reduce.h.
+ *
+ * Each delta d = x[i] - x[i-1] is mapped to u = 2d (d >= 0) or -2d-1 (d < 0)
+ * and coded as q = u >> k ones, a zero and the k low bits of u. If q >= 16,
+ * 16 ones are followed by u in FIS_COMP_ESC_BITS bits instead.
+ */
+
+#ifndef _FIS_COMP_
+#define _FIS_COMP_
+
+#include "fis_payload.h"
+
+//k value of a block that holds the raw samples
+#define FIS_COMP_RAW_K (0xF)
+//largest number of samples of a block
+#define FIS_COMP_MAX_SAMPLES (0x0FFF)
+//longest unary prefix before the escape
+#define FIS_COMP_ESC_Q (16)
+//bits of an escaped value (zigzag of a 10 bits delta)
+#define FIS_COMP_ESC_BITS (11)
+//words needed by a block of n samples in the worst case (raw)
+#define FIS_COMP_BLOCK_LEN(n) ((n) + 3)
+
+/**
+ * Codes one block of 10 bits samples
+ * @param src Samples (sens_buff)
+ * @param n Number of samples, max FIS_COMP_MAX_SAMPLES
+ * @param dst Output buffer of at least FIS_COMP_BLOCK_LEN(n) words
+ * @return Number of words written into dst, 0 if n is out of range
+ */
+unsigned int fis_comp_encode(const unsigned int *src, unsigned int n, unsigned int *dst);
+
+#endif
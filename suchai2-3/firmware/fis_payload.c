@@ -18,7 +18,11 @@
  */
 
 #include "fis_payload.h"
+#include "fis_wave.h"
+#include "fis_reduce.h"
 #include "interfaz_ADC.h"
+#include "FreeRTOS.h"
+#include "semphr.h"
 
 #define _FISICA_VERBOSE_ITERATE      (0)
 #define _FISICA_VERBOSE_TIMER4_ISR   (0)
@@ -28,10 +32,36 @@
 #define _FISICA_VERBOSE_ADC_CFG      (0)
 #define _FISICA_VERBOSE_DAC_SPI      (0)
 
+/*
+ * The acquisition ISRs (T2, T4, T5 and ADC1) run at FIS_ISR_IPL, above the
+ * kernel priority, so portENTER_CRITICAL does not mask them. The task
+ * touches the state they share between fis_isr_lock and fis_isr_unlock
+ */
+#define FIS_ISR_IPL (4)
+#define fis_isr_lock(save)      SET_AND_SAVE_CPU_IPL(save, FIS_ISR_IPL)
+#define fis_isr_unlock(save)    RESTORE_CPU_IPL(save)
+
+/*
+ * They can not call the FreeRTOS API either. fis_sens_buff_swap raises the
+ * CRC interrupt flag by hand (the CRC module is not used), and its ISR gives
+ * fis_sem_buff at the kernel priority
+ */
+#define fis_swi_config()    { IPC16bits.CRCIP = configKERNEL_INTERRUPT_PRIORITY; IFS4bits.CRCIF = 0; IEC4bits.CRCIE = 1; }
+#define fis_swi_trigger()   (IFS4bits.CRCIF = 1)
+
+#if FIS_SAMPLES_PER_POINT > FIS_SAMPLES_PER_POINT_MAX
+    #error "FIS_ADC_HW_BURST needs FIS_SAMPLES_PER_POINT <= 16 (size of ADC1BUF)"
+#endif
+#if (FIS_SENS_BUFF_LEN % (2*FIS_SAMPLES_PER_POINT)) != 0
+    #error "FIS_ADC_HW_DUAL needs a sens_buff of whole points of (Vout, Vin) pairs"
+#endif
+
 /*
  * Global parameters being used in the execution of this payload
  */
 static unsigned int fis_state;    //working state
+static FIS_Geometry fis_geom = {FIS_SIGNAL_POINTS, FIS_SAMPLES_PER_POINT, FIS_SENS_BUFF_LEN, FIS_POINTS_INB4};
+static unsigned int fis_signal_samples = FIS_SIGNAL_SAMPLES;    //signal_points*samples_per_point
 static unsigned int fis_signal_period;
 static unsigned int fis_seed;
 static BOOL fis_seed_is_set = FALSE;
@@ -40,21 +70,92 @@ static unsigned int fis_current_round;   //index of the current waveform being e
 static unsigned int fis_point;  //counter for the total waveform points
 static unsigned int fis_aux_points;  //counter for the total waveform points
 static unsigned int fis_sample;  //total number of samples to be done
-static unsigned int sens_buff[FIS_SENS_BUFF_LEN];   //temporary buffer where the measures are stored
-static int sens_buff_ind;   //index used with sens_buff
+static unsigned int sens_buff[FIS_SENS_BUFF_NUM][FIS_SENS_BUFF_LEN];   //ping-pong buffers where the measures are stored
+static unsigned int dac_buff[FIS_SENS_BUFF_NUM][FIS_SENS_BUFF_POINTS];   //DAC value of each point in sens_buff
+static unsigned int fis_dac_value;  //last value written by the DAC ISR
+static unsigned int fis_dac_table[FIS_DAC_TABLE_LEN];  //next DAC codes, filled by the task
+static unsigned int fis_dac_head;   //next free slot of fis_dac_table (task)
+static unsigned int fis_dac_tail;   //next code to play (DAC ISR)
+static volatile unsigned int fis_dac_count;    //codes waiting in fis_dac_table
+static unsigned int fis_dac_underruns;  //DAC points generated inside the ISR (empty table)
+static unsigned long fis_rng_next;  //fis_rng() counter of the next code put into fis_dac_table
+static int sens_buff_ind;   //index used with sens_buff[sens_buff_fill]
+static unsigned int sens_buff_fill;    //sens_buff being filled by the ISRs
+static unsigned int sens_buff_drain;   //sens_buff being saved by the task
+static volatile unsigned int sens_buff_ready;  //number of full sens_buff waiting to be saved
+static unsigned int fis_resumes;   //number of times the acquisition was resumed (each one replays the burn-in)
+static xSemaphoreHandle fis_sem_buff = NULL;   //given by _CRCInterrupt every time a sens_buff is full
 static BOOL sync;
 static BOOL beginValidPoints;
 static unsigned int meanValue = RAND_MAX;
+static unsigned int fis_adc_mode = FIS_ADC_SOFT_TRIGGER;  //how the ADC conversions are started
+static unsigned int fis_output = FIS_OUTPUT_RAW;  //what pay_exec_expFis saves, FIS_OUTPUT_xxx mask
+static unsigned int fis_reduce = FIS_REDUCE_NONE;   //what is saved of the samples of a point, see Fis_Reductions
+static unsigned int fis_waveform = FIS_WAVE_UNIFORM;    //stimulus of the DAC, see Fis_Waveforms
+static BOOL fis_armed = FALSE;  //ADC and timers configured for fis_signal_period and fis_adc_mode
+static unsigned int fis_profile = FIS_PROFILE_SUCHAI23; //mission profile, see Fis_Profiles
+static unsigned int fis_profile_flags = FIS_PROFILE_PARK_DAC;   //FIS_PROFILE_xxx behaviours of fis_profile
+static unsigned int fis_timing = FIS_TIMING_SEPARATE;   //what clocks the DAC, see Fis_Timings
+static unsigned int fis_dac_phase = 0;  //FIS_TIMING_LOCKED: timer counts from the DAC update to the conversion
+static BOOL fis_conv_delayed = FALSE;   //FIS_TIMING_LOCKED with phase: Timer3 starts each conversion
+static unsigned int fis_dac_countdown;  //FIS_TIMING_LOCKED: ADC samples left before the next DAC update
+
+/*
+ * Timer snapshots of each sens_buff, taken by the ADC ISR
+ */
+typedef struct{
+    unsigned int buff;          //number of the sens_buff in the run
+    unsigned long start;        //clock at the first sample
+    unsigned long end;          //clock at the last sample
+    unsigned int tmr4_start;
+    unsigned int tmr_adc_start;
+    unsigned int tmr4_end;
+    unsigned int tmr_adc_end;
+    unsigned int nstamps;
+    unsigned long stamps[FIS_TIME_MAX_STAMPS];
+    BOOL resumed;               //first sens_buff after a pause or the start of the run
+} FIS_TimeCapture;
+
+static FIS_TimeCapture fis_time[FIS_SENS_BUFF_NUM];
+static unsigned int fis_time_buffs;     //sens_buff filled in this run
+static unsigned int fis_time_every_req = 0;  //samples between stamps asked by fis_set_time_stamps
+static unsigned int fis_time_every = 0; //samples between stamps in this run, 0 = no stamps
+static unsigned int fis_time_left;      //samples left before the next stamp
+static volatile unsigned int fis_clock_hi;  //high word of the Timer2 clock
+static BOOL fis_dac_fast = FALSE;   //SPI3 in enhanced buffer mode, see fis_dac_spi_fast
+static BOOL fis_dac_pending = FALSE;    //a DAC frame is being sent, SPI_nSS_3 still low
+static BOOL fis_after_resume;   //the next sens_buff begins after a pause, the circuit is settling
+static unsigned int fis_settle_points = 0;  //transient rejection, see fis_set_settle
+static unsigned int fis_settle_tol = FIS_SETTLE_TOL_DEFAULT;
+static unsigned long fis_settle_discarded;  //samples discarded as transient in this run
+
+/*
+ * Latency and duration counters of one ISR
+ */
+typedef struct{
+    unsigned long n;            //calls
+    unsigned int lat_min;       //Tcy from the timer period match to the ISR entry (trigger to ISR for the ADC)
+    unsigned int lat_max;
+    unsigned long lat_sum;
+    unsigned int dur_min;       //Tcy from the ISR entry to its exit
+    unsigned int dur_max;
+    unsigned long dur_sum;
+    unsigned int missed;        //timer period matches passed before the ISR exit
+} FIS_IsrStats;
+
+static FIS_IsrStats fis_isr_stats[FIS_ISR_LAST_ONE];
+static unsigned long fis_isr_run_start;     //clock at the last fis_Timer45_begin
+static unsigned long fis_isr_run_cycles;    //Tcy the acquisition was running
 
 unsigned int fis_get_total_number_of_samples(void){
-    return FIS_SIGNAL_POINTS*fis_rounds*FIS_SAMPLES_PER_POINT;
+    return fis_signal_samples*fis_rounds;
 }
 
 /* 
  * Return the size of the sens_buff
  */
 unsigned int fis_get_sens_buff_size(void){
-    return FIS_SENS_BUFF_LEN;
+    return fis_geom.buff_len;
 }
 
 /* 
@@ -65,25 +166,36 @@ unsigned int fis_get_state(void){
 }
 
 /* 
- * Initialize the buffer with the seeds values used with rand() in the DAC
+ * Sets the seed of the stimulus generated by fis_rng() in the DAC
  */
  void fis_seed_init(unsigned int seedValue){
-    srand(seedValue);
     fis_seed = seedValue;
     fis_seed_is_set = TRUE;
 }
 
 /* 
  * This function waits until the current payload iteration is completed.
- * If "sens_buff" is not full takes too long to be filled, then this function
+ * The calling task blocks on fis_sem_buff, given (through _CRCInterrupt)
+ * when the ADC ISR fills a "sens_buff", so it wakes up as soon as there is data to save.
+ * If "sens_buff" takes too long to be filled, then this function
  * triggers a timeout and return a error return-code.
  */
 int fis_wait_busy_wtimeout(unsigned int timeout){
     int seg_timeout = timeout;   
+    portTickType ticks_timeout = (portTickType)(((unsigned long)timeout*1000UL)/portTICK_RATE_MS);
 
     while(!(fis_sens_buff_isFull())){
-        __delay_ms(1000)
-        seg_timeout--;
+        if(fis_sem_buff != NULL){
+            if(xSemaphoreTake(fis_sem_buff, ticks_timeout) == pdTRUE){
+                continue;   //check again, the semaphore may be from a sens_buff already saved
+            }
+            seg_timeout = 0;
+        }
+        else{
+            //no semaphore available, fall back to polling
+            __delay_ms(1000)
+            seg_timeout--;
+        }
         if(seg_timeout<=0){ 
         #if _FISICA_VERBOSE_ITERATE > 0
             printf("fis_wait_busy_wtimeout: expFis timeout!\n");
@@ -98,52 +210,190 @@ int fis_wait_busy_wtimeout(unsigned int timeout){
 }
 
 /*
- * Prints all the elements inside the temporary buffer "sens_buff". Use for debuggoing
+ * Prints all the elements inside the "sens_buff" waiting to be saved. Use for debuggoing
  * 
  */
 void fis_print_sens_buff(void){
     int ind;
-    for(ind=0; ind<FIS_SENS_BUFF_LEN; ind++){
+    for(ind=0; ind<fis_geom.buff_len; ind++){
         if(ind%2==0){
-            printf("sens_buff[%02d]=%04d, ", ind, sens_buff[ind]);
+            printf("sens_buff[%02d]=%04d, ", ind, sens_buff[sens_buff_drain][ind]);
         }
         else{
-            printf("sens_buff[%02d]=%04d\n", ind, sens_buff[ind]);
+            printf("sens_buff[%02d]=%04d\n", ind, sens_buff[sens_buff_drain][ind]);
         }
     }
 }
 
 /*
- * Erase all the values stored inside "sen_buff"
+ * Erase all the values stored inside every "sen_buff"
  */
 void fis_sens_buff_reset(void){
     printf("sens_buff reset \n");
-    int ind;
-    for(ind = 0; ind < FIS_SENS_BUFF_LEN ; ind++){
-        sens_buff[ind] = 0;
+    int i, ind;
+    for(i = 0; i < FIS_SENS_BUFF_NUM; i++){
+        for(ind = 0; ind < FIS_SENS_BUFF_LEN ; ind++){
+            sens_buff[i][ind] = 0;
+        }
     }
     sens_buff_ind = 0;
+    sens_buff_fill = 0;
+    sens_buff_drain = 0;
+    sens_buff_ready = 0;
+    fis_resumes = 0;
+    fis_after_resume = TRUE;
+    fis_settle_discarded = 0;
+    fis_dac_head = 0;
+    fis_dac_tail = 0;
+    fis_dac_count = 0;
+    fis_dac_underruns = 0;
+    fis_time_buffs = 0;
+    fis_isr_reset();
 }
 
 /*
- * Returns the value of sens_buff[ind]
+ * Returns the value of sens_buff[ind] of the buffer waiting to be saved
  * @param ind Index of the element
  * @return value of sens_buff[ind] if it exist, else returns 0
  */
 unsigned int fis_get_sens_buff_i(int ind){
-    if(ind>=FIS_SENS_BUFF_LEN){return 0;}
-    return sens_buff[ind];
+    if(ind>=fis_geom.buff_len){return 0;}
+    return sens_buff[sens_buff_drain][ind];
+}
+
+/*
+ * Returns the sens_buff waiting to be saved, so it can be written into the
+ * Data Repository without copying it. Valid until fis_sens_buff_release()
+ */
+const unsigned int* fis_get_sens_buff(void){
+    return sens_buff[sens_buff_drain];
+}
+
+/*
+ * Returns the DAC values of the points inside the sens_buff waiting to be
+ * saved. dac_buff[i] is the input of the samples_per_point samples from
+ * sens_buff[i*samples_per_point] (i*2*samples_per_point in FIS_ADC_HW_DUAL mode)
+ */
+const unsigned int* fis_get_dac_buff(void){
+    return dac_buff[sens_buff_drain];
+}
+
+/*
+ * Gives back the sens_buff already saved into the Data Repository, so the
+ * ISRs can fill it again. Call it once per full sens_buff
+ */
+void fis_sens_buff_release(void){
+    int ipl;
+    if(sens_buff_ready == 0){return;}
+
+    fis_isr_lock(ipl);
+    sens_buff_ready--;
+    fis_isr_unlock(ipl);
+    sens_buff_drain = (sens_buff_drain+1)%(unsigned int)FIS_SENS_BUFF_NUM;
+}
+
+/*
+ * Hands the full sens_buff over to the task and moves the ISRs to the next one.
+ * The acquisition is paused only when the waveform is complete or when the
+ * next sens_buff was not saved yet. Call it only from the ADC ISR
+ */
+static void fis_sens_buff_swap(void){
+    sens_buff_ready++;
+    sens_buff_fill = (sens_buff_fill+1)%(unsigned int)FIS_SENS_BUFF_NUM;
+    fis_swi_trigger();  //wakes the task once back below FIS_ISR_IPL
+
+    if(fis_sample == fis_signal_samples || sens_buff_ready == FIS_SENS_BUFF_NUM){
+        fis_iterate_pause();
+    }
+    else{
+        sens_buff_ind = 0;  //keep going, no pause (and no burn-in) needed
+    }
+}
+
+unsigned int fis_rng(unsigned int seed, unsigned long n){
+    unsigned long x = n ^ ((unsigned long)seed * 0x9E3779B9UL);
+    x ^= x >> 16;
+    x *= 0x85EBCA6BUL;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35UL;
+    x ^= x >> 16;
+    return (unsigned int)(x >> 16);
+}
+
+/*
+ * DAC code of the n-th point played (n = round*signal_points + point, the
+ * burn-in is at negative points). With FIS_PROFILE_ROUND_SEED each round is
+ * the stimulus of seed+round, from its point 0, and the burn-in before round
+ * 0 is played with seed as without the flag
+ */
+static unsigned int fis_stimulus(unsigned long n){
+    unsigned int r;
+    if((fis_profile_flags & FIS_PROFILE_ROUND_SEED) && (long)n >= 0){
+        r = (unsigned int)(n / fis_geom.signal_points);
+        return fis_wave_code(fis_waveform, fis_seed + r, n - (unsigned long)r*fis_geom.signal_points);
+    }
+    return fis_wave_code(fis_waveform, fis_seed, n);
+}
+
+/*
+ * Generates the next DAC codes into fis_dac_table until it is full, so the
+ * Timer4 ISR does not compute them. Call it from task context, before starting
+ * the acquisition and every time a sens_buff is saved
+ */
+void fis_dac_table_fill(void){
+    int ipl;
+    while(fis_dac_count < (unsigned int)FIS_DAC_TABLE_LEN){
+        //the DAC ISR may take a code itself if the table runs empty, so
+        //fis_rng_next and the fis_wave state are only used with it masked
+        fis_isr_lock(ipl);
+        fis_dac_table[fis_dac_head] = fis_stimulus(fis_rng_next++);
+        fis_dac_head = (fis_dac_head+1 == (unsigned int)FIS_DAC_TABLE_LEN)? 0 : fis_dac_head+1;
+        fis_dac_count++;
+        fis_isr_unlock(ipl);
+    }
+}
+
+/*
+ * Empties fis_dac_table and jumps the generator to the burn-in of the next
+ * point to be measured. Call it only with the DAC ISR stopped, before
+ * starting or resuming the acquisition
+ */
+static void fis_dac_table_restart(void){
+    unsigned long next_point = (unsigned long)fis_current_round*fis_geom.signal_points
+            + fis_sample/fis_geom.samples_per_point;
+    fis_dac_head = 0;
+    fis_dac_tail = 0;
+    fis_dac_count = 0;
+    fis_rng_next = next_point - fis_geom.points_inb4;
+}
+
+/*
+ * Return the number of DAC points the Timer4 ISR had to generate because
+ * fis_dac_table was empty (the task did not refill it in time)
+ */
+unsigned int fis_get_dac_underrun_count(void){
+    return fis_dac_underruns;
+}
+
+/*
+ * Return the number of times the acquisition was paused and resumed in the
+ * middle of a waveform. Each resume replays the points_inb4 burn-in points
+ * before the next point k (stimulus k-points_inb4 .. k-1, see
+ * fis_dac_table_restart), so the Vin of a point does not depend on the pauses
+ */
+unsigned int fis_get_resume_count(void){
+    return fis_resumes;
 }
 
 /*
- * Asks if the temporary buffer "sens_buff" is full
+ * Asks if there is a full "sens_buff" waiting to be saved
  * @return
- *          TRUE if sens_buff is full
+ *          TRUE if a sens_buff is full
  *          FALSE if not
  */
 BOOL fis_sens_buff_isFull(void){
     
-    if( sens_buff_ind < FIS_SENS_BUFF_LEN ){
+    if( sens_buff_ready == 0 ){
         return FALSE;
     }
     return TRUE;
@@ -175,9 +425,19 @@ unsigned int fis_reset_iteration_variables(void){
     fis_sample = 0;
     fis_aux_points = 0;
     sync = FALSE;
-    beginValidPoints = FALSE;
+    beginValidPoints = (fis_geom.points_inb4 == 0)? TRUE : FALSE;
     fis_state = FIS_STATE_READY;  //ready for init the execution
     fis_sens_buff_reset();  //reset the buffer and clears it
+    fis_wave_config(fis_geom.signal_points);
+    fis_set_time_stamps(fis_time_every_req);    //the geometry or the ADC mode may have changed
+
+    if(fis_sem_buff == NULL){
+        vSemaphoreCreateBinary(fis_sem_buff);
+    }
+    if(fis_sem_buff != NULL){
+        xSemaphoreTake(fis_sem_buff, 0);    //binary semaphores are created "given"
+    }
+    fis_swi_config();
 
     return fis_state;
 }
@@ -189,12 +449,437 @@ unsigned int fis_set_seed(unsigned int seed, int rounds){
 }
 
 unsigned int fis_set_adcPeriod(unsigned int inputSignalPeriod, int rounds){
-    fis_signal_period = inputSignalPeriod;
+    if(inputSignalPeriod != fis_signal_period){
+        fis_armed = FALSE;  //timers must be configured again
+    }
     fis_rounds = rounds;
     fis_signal_period = inputSignalPeriod;
     return fis_state;
 }
 
+/*
+ * Selects how the ADC conversions are started (see Fis_AdcModes). It can only
+ * be changed while the experiment is not running
+ * @param mode One of Fis_AdcModes
+ * @return the state of the payload
+ */
+unsigned int fis_set_adcMode(unsigned int mode){
+    if(fis_state == FIS_STATE_WORKING || fis_state == FIS_STATE_WAITING){
+        printf("fis_set_adcMode: expFis is running, mode not changed\n");
+        return fis_state;
+    }
+    if(mode >= FIS_ADC_LAST_ONE){
+        printf("fis_set_adcMode: invalid mode %u\n", mode);
+        return fis_state;
+    }
+    if(mode != fis_adc_mode){
+        fis_armed = FALSE;  //ADC and timers must be configured again
+    }
+    fis_adc_mode = mode;
+    return fis_state;
+}
+
+unsigned int fis_get_adcMode(void){
+    return fis_adc_mode;
+}
+
+/*
+ * Selects the stimulus of the DAC (see Fis_Waveforms). It can only be changed
+ * while the experiment is not running
+ * @param wave One of Fis_Waveforms
+ * @return the state of the payload
+ */
+unsigned int fis_set_waveform(unsigned int wave){
+    if(fis_state == FIS_STATE_WORKING || fis_state == FIS_STATE_WAITING){
+        printf("fis_set_waveform: expFis is running, waveform not changed\n");
+        return fis_state;
+    }
+    if(wave >= FIS_WAVE_LAST_ONE){
+        printf("fis_set_waveform: invalid waveform %u\n", wave);
+        return fis_state;
+    }
+    fis_waveform = wave;
+    return fis_state;
+}
+
+unsigned int fis_get_waveform(void){
+    return fis_waveform;
+}
+
+BOOL fis_check_geometry(const FIS_Geometry *g){
+    unsigned long samples = (unsigned long)g->signal_points*g->samples_per_point;
+    if(g->samples_per_point == 0 || g->samples_per_point > FIS_SAMPLES_PER_POINT_MAX){ return FALSE; }
+    if(g->buff_len == 0 || g->buff_len > FIS_SENS_BUFF_LEN){ return FALSE; }         //sens_buff RAM
+    if(g->buff_len % (2*g->samples_per_point) != 0){ return FALSE; }                 //whole points, also as pairs
+    if(g->buff_len/g->samples_per_point > FIS_SENS_BUFF_POINTS){ return FALSE; }    //dac_buff RAM
+    if(g->points_inb4 > FIS_POINTS_INB4){ return FALSE; }   //fis_dac_table RAM, 0 = no burn-in
+    if(g->signal_points < FIS_SIGNAL_POINTS_MIN || samples > 0xFFFF){ return FALSE; } //fis_sample, Data Repository index
+    if(samples % g->buff_len != 0){ return FALSE; }     //a waveform ends with a full sens_buff
+    return TRUE;
+}
+
+BOOL fis_set_geometry(const FIS_Geometry *g){
+    if(fis_state == FIS_STATE_WORKING || fis_state == FIS_STATE_WAITING){
+        printf("fis_set_geometry: expFis is running, geometry not changed\n");
+        return FALSE;
+    }
+    if(!fis_check_geometry(g)){
+        printf("fis_set_geometry: invalid geometry %u/%u/%u/%u\n", g->signal_points,
+                g->samples_per_point, g->buff_len, g->points_inb4);
+        return FALSE;
+    }
+    if(g->samples_per_point != fis_geom.samples_per_point){
+        fis_armed = FALSE;  //Timer4 period and SMPI
+    }
+    fis_geom = *g;
+    fis_signal_samples = fis_geom.signal_points*fis_geom.samples_per_point;
+    fis_wave_config(fis_geom.signal_points);
+    return TRUE;
+}
+
+const FIS_Geometry* fis_get_geometry(void){
+    return &fis_geom;
+}
+
+unsigned int fis_geom_get_record(unsigned int *rec){
+    unsigned int i = 0;
+    rec[i++] = FIS_GEOM_RECORD_ID;
+    rec[i++] = fis_signal_period;
+    rec[i++] = fis_seed;
+    rec[i++] = (unsigned int)fis_rounds;
+    rec[i++] = fis_geom.signal_points;
+    rec[i++] = fis_geom.samples_per_point;
+    rec[i++] = fis_geom.buff_len;
+    rec[i++] = fis_geom.points_inb4;
+    rec[i++] = fis_profile;
+    rec[i++] = fis_profile_flags;
+    rec[i++] = fis_reduce;
+    rec[i++] = (fis_settle_tol << 12) | fis_settle_points;
+    rec[i++] = (unsigned int)(fis_settle_discarded>>0);
+    rec[i++] = (unsigned int)(fis_settle_discarded>>16);
+    return i;
+}
+
+static const FIS_Profile fis_profiles[FIS_PROFILE_LAST_ONE] = {
+    //FIS_PROFILE_SUCHAI23
+    {{FIS_SIGNAL_POINTS, FIS_SAMPLES_PER_POINT, FIS_SENS_BUFF_LEN, FIS_POINTS_INB4},
+        FIS_PROFILE_PARK_DAC, FIS_ADC_SOFT_TRIGGER, FIS_TIMING_SEPARATE, FIS_WAVE_UNIFORM},
+    //FIS_PROFILE_SUCHAI1, as flown: 1000 points, 200 samples per sens_buff
+    {{1000, 4, 200, 0},
+        FIS_PROFILE_ROUND_SEED, FIS_ADC_SOFT_TRIGGER, FIS_TIMING_SEPARATE, FIS_WAVE_UNIFORM},
+};
+
+BOOL fis_set_profile(unsigned int profile){
+    const FIS_Profile *p;
+    if(profile >= FIS_PROFILE_LAST_ONE){
+        printf("fis_set_profile: invalid profile %u\n", profile);
+        return FALSE;
+    }
+    p = &fis_profiles[profile];
+    if(!fis_set_geometry(&p->geom)){
+        return FALSE;   //expFis is running
+    }
+    fis_set_adcMode(p->adc_mode);
+    fis_set_timing(p->timing, fis_dac_phase);
+    fis_set_waveform(p->waveform);
+    fis_profile = profile;
+    fis_profile_flags = p->flags;
+    return TRUE;
+}
+
+unsigned int fis_get_profile(void){
+    return fis_profile;
+}
+
+unsigned int fis_get_profile_flags(void){
+    return fis_profile_flags;
+}
+
+/*
+ * Selects what clocks the DAC (see Fis_Timings). With FIS_TIMING_LOCKED the
+ * ADC clock is the only timer and the DAC is updated every
+ * samples_per_point samples from the ADC ISR. In FIS_ADC_SOFT_TRIGGER mode
+ * each conversion starts phase timer counts (1:64 prescaler) after the tick
+ * that updates the DAC, phase is limited to the ADC period. The delay is a
+ * one-shot of Timer3 (not used by this mode), not a wait inside the ISR. In the hardware
+ * trigger modes the DAC is updated right after the last sample of a point, one
+ * ADC period before the first sample of the next one, and phase is not used.
+ * It can only be changed while the experiment is not running
+ * @param timing One of Fis_Timings
+ * @param phase Timer counts between the DAC update and each conversion
+ * @return the state of the payload
+ */
+unsigned int fis_set_timing(unsigned int timing, unsigned int phase){
+    if(fis_state == FIS_STATE_WORKING || fis_state == FIS_STATE_WAITING){
+        printf("fis_set_timing: expFis is running, timing not changed\n");
+        return fis_state;
+    }
+    if(timing >= FIS_TIMING_LAST_ONE){
+        printf("fis_set_timing: invalid timing %u\n", timing);
+        return fis_state;
+    }
+    if(timing != fis_timing || phase != fis_dac_phase){
+        fis_armed = FALSE;  //Timer4 is used or not, Timer3 one-shot
+    }
+    fis_timing = timing;
+    fis_dac_phase = phase;
+    return fis_state;
+}
+
+unsigned int fis_get_timing(void){
+    return fis_timing;
+}
+
+unsigned int fis_get_dac_phase(void){
+    return fis_dac_phase;
+}
+
+/*
+ * The interval is fitted to the current geometry and ADC mode: a sens_buff
+ * holds buff_len samples, or buff_len/2 (Vout, Vin) pairs in FIS_ADC_HW_DUAL.
+ * Fitted again at the start of every run
+ */
+void fis_set_time_stamps(unsigned int every){
+    unsigned int samples = (fis_adc_mode == FIS_ADC_HW_DUAL)? fis_geom.buff_len/2 : fis_geom.buff_len;
+    unsigned int min = (unsigned int)((samples + FIS_TIME_MAX_STAMPS - 1)/FIS_TIME_MAX_STAMPS);
+    fis_time_every_req = every;
+    if(every != 0 && every < min){
+        every = min;    //no more than FIS_TIME_MAX_STAMPS per sens_buff
+    }
+    if(every != 0 && every < fis_geom.samples_per_point){
+        every = fis_geom.samples_per_point;  //FIS_ADC_HW_BURST stores a point at a time
+    }
+    fis_time_every = every;
+}
+
+static unsigned int fis_time_put_long(unsigned int *rec, unsigned long value){
+    rec[0] = (unsigned int)(value>>0);
+    rec[1] = (unsigned int)(value>>16);
+    return 2;
+}
+
+unsigned int fis_time_get_record(unsigned int *rec){
+    const FIS_TimeCapture *t = &fis_time[sens_buff_drain];
+    unsigned int samples = (fis_adc_mode == FIS_ADC_HW_DUAL)? fis_geom.buff_len/2 : fis_geom.buff_len;
+    unsigned int i = 0, j;
+
+    rec[i++] = FIS_TIME_RECORD_ID;
+    rec[i++] = fis_signal_period;
+    rec[i++] = fis_seed;
+    rec[i++] = t->buff;
+    rec[i++] = samples;
+    rec[i++] = fis_time_every;
+    i += fis_time_put_long(&rec[i], t->start);
+    i += fis_time_put_long(&rec[i], t->end);
+    rec[i++] = t->tmr4_start;
+    rec[i++] = t->tmr_adc_start;
+    rec[i++] = t->tmr4_end;
+    rec[i++] = t->tmr_adc_end;
+    rec[i++] = t->nstamps;
+    for(j = 0; j < t->nstamps; j++){
+        i += fis_time_put_long(&rec[i], t->stamps[j]);
+    }
+    return i;
+}
+
+/*
+ * Free running Tcy clock for the timing records: Timer2 at 1:1, the T2 ISR
+ * counts the high word. Started by fis_arm, it keeps running across the
+ * pauses of a run
+ */
+static void fis_clock_config(void){
+    T2CON = 0x0000;     //T2_OFF & T2_GATE_OFF & T2_IDLE_CON & T2_PS_1_1 & T2_SOURCE_INT & T2_32BIT_MODE_OFF
+    TMR2 = 0;
+    PR2 = 0xFFFF;
+    fis_clock_hi = 0;
+    IPC1bits.T2IP = FIS_ISR_IPL;    //same priority of the ADC ISRs, so it never splits a read
+    IFS0bits.T2IF = 0;
+    IEC0bits.T2IE = 1;
+    T2CONbits.TON = 1;
+}
+
+/*
+ * Reads the Timer2 clock. Call it from the ADC ISRs or, from the task, between
+ * fis_isr_lock and fis_isr_unlock: a pending overflow is added by hand
+ */
+static inline unsigned long fis_clock_read(void){
+    unsigned int lo = TMR2;
+    unsigned int hi = fis_clock_hi;
+    if(IFS0bits.T2IF && lo < 0x8000){
+        hi++;
+    }
+    return ((unsigned long)hi << 16) | lo;
+}
+
+void fis_isr_reset(void){
+    unsigned int i;
+    for(i = 0; i < FIS_ISR_LAST_ONE; i++){
+        fis_isr_stats[i].n = 0;
+        fis_isr_stats[i].lat_min = 0xFFFF;
+        fis_isr_stats[i].lat_max = 0;
+        fis_isr_stats[i].lat_sum = 0;
+        fis_isr_stats[i].dur_min = 0xFFFF;
+        fis_isr_stats[i].dur_max = 0;
+        fis_isr_stats[i].dur_sum = 0;
+        fis_isr_stats[i].missed = 0;
+    }
+    fis_isr_run_cycles = 0;
+}
+
+/*
+ * Adds one call of an ISR, at its exit
+ * @param st Counters of the ISR
+ * @param tmr Its timer at the ISR entry (counts since the period match)
+ * @param t0 TMR2 at the ISR entry
+ * @param pr Period register of its timer, every match passed between the
+ * one that triggered the ISR and its exit is a missed deadline
+ */
+static inline void fis_isr_stats_add(FIS_IsrStats *st, unsigned int tmr, unsigned int t0, unsigned int pr){
+    unsigned int dur = TMR2 - t0;
+    unsigned int lat = (tmr > 0x03FF)? 0xFFFF : (tmr << 6);    //1:64 prescaler
+    unsigned long elapsed = (unsigned long)tmr + (dur >> 6);    //timer counts since the match
+    st->n++;
+    if(lat < st->lat_min){ st->lat_min = lat; }
+    if(lat > st->lat_max){ st->lat_max = lat; }
+    st->lat_sum += lat;
+    if(dur < st->dur_min){ st->dur_min = dur; }
+    if(dur > st->dur_max){ st->dur_max = dur; }
+    st->dur_sum += dur;
+    if(elapsed > pr){ st->missed += (unsigned int)(elapsed / ((unsigned long)pr + 1)); }
+}
+
+/*
+ * x/total in 1/1000, saturated to 1000
+ */
+static unsigned int fis_isr_permil(unsigned long x, unsigned long total){
+    total = total/1000;
+    if(total == 0 || x/total > 1000){ return (total == 0)? 0 : 1000; }
+    return (unsigned int)(x/total);
+}
+
+unsigned int fis_isr_get_record(unsigned int *rec){
+    unsigned int i = 0, j;
+    unsigned long busy = 0;
+    const FIS_IsrStats *st;
+
+    rec[i++] = FIS_ISR_RECORD_ID;
+    rec[i++] = fis_signal_period;
+    rec[i++] = fis_seed;
+    i += fis_time_put_long(&rec[i], fis_isr_run_cycles);
+    for(j = 0; j < FIS_ISR_LAST_ONE; j++){
+        busy += fis_isr_stats[j].dur_sum;
+    }
+    rec[i++] = fis_isr_permil(busy, fis_isr_run_cycles);
+    for(j = 0; j < FIS_ISR_LAST_ONE; j++){
+        st = &fis_isr_stats[j];
+        i += fis_time_put_long(&rec[i], st->n);
+        rec[i++] = (st->n == 0)? 0 : st->lat_min;
+        rec[i++] = st->lat_max;
+        rec[i++] = (st->n == 0)? 0 : (unsigned int)(st->lat_sum/st->n);
+        rec[i++] = (st->n == 0)? 0 : st->dur_min;
+        rec[i++] = st->dur_max;
+        rec[i++] = (st->n == 0)? 0 : (unsigned int)(st->dur_sum/st->n);
+        rec[i++] = st->missed;
+        rec[i++] = fis_isr_permil(st->dur_sum, fis_isr_run_cycles);
+    }
+    return i;
+}
+
+void fis_isr_print(void){
+    unsigned int rec[FIS_ISR_RECORD_LEN];
+    unsigned int i, len;
+    len = fis_isr_get_record(rec);
+    printf("fis_isr record: ");
+    for(i = 0; i < len; i++){
+        printf("0x%04X,", rec[i]);
+    }
+    printf("\n");
+}
+
+/*
+ * Turns on/off the timer and the interruption that clock the ADC samples:
+ * Timer5 and its ISR (soft trigger) or Timer3 and the ADC ISR (hardware trigger)
+ */
+static void fis_ADC_clock_enable(BOOL on){
+    if(fis_adc_mode == FIS_ADC_SOFT_TRIGGER){
+        T5CONbits.TON = on;
+        IEC1bits.T5IE = on;
+        if(fis_conv_delayed){
+            T3CONbits.TON = 0;  //drops a conversion still pending
+            IFS0bits.T3IF = 0;
+            IEC0bits.T3IE = on;
+        }
+    }
+    else{
+        T3CONbits.TON = on;
+        IEC0bits.AD1IE = on;
+    }
+}
+
+unsigned int fis_get_seed(void){
+    return fis_seed;
+}
+
+unsigned int fis_get_adcPeriod(void){
+    return fis_signal_period;
+}
+
+/*
+ * Selects the data pay_exec_expFis saves into the Data Repository
+ * @param output Mask of FIS_OUTPUT_xxx values
+ * @return the state of the payload
+ */
+unsigned int fis_set_output(unsigned int output){
+    fis_output = output;
+    return fis_state;
+}
+
+unsigned int fis_get_output(void){
+    return fis_output;
+}
+
+unsigned int fis_set_reduce(unsigned int mode){
+    if(mode >= FIS_REDUCE_LAST_ONE){
+        printf("fis_set_reduce: invalid mode %u\n", mode);
+        return fis_state;
+    }
+    fis_reduce = mode;
+    return fis_state;
+}
+
+unsigned int fis_get_reduce(void){
+    return fis_reduce;
+}
+
+void fis_set_settle(unsigned int points, unsigned int tol){
+    fis_settle_points = (points > FIS_SETTLE_AUTO)? FIS_SETTLE_AUTO : points;
+    fis_settle_tol = (tol == 0)? FIS_SETTLE_TOL_DEFAULT : ((tol > 0x000F)? 0x000F : tol);  //4 bits in the geometry record
+}
+
+unsigned int fis_get_settle(void){
+    return fis_settle_points;
+}
+
+unsigned int fis_sens_buff_settle(void){
+    unsigned int spp = fis_geom.samples_per_point;
+    BOOL pairs = (fis_adc_mode == FIS_ADC_HW_DUAL)? TRUE : FALSE;
+    unsigned int max = fis_geom.buff_len/spp/((pairs)? 2 : 1)/2;  //half of the points
+    unsigned int points;
+
+    if(fis_settle_points == 0 || fis_time[sens_buff_drain].resumed == FALSE){
+        return 0;
+    }
+    if(fis_settle_points == FIS_SETTLE_AUTO){
+        points = fis_reduce_settle(sens_buff[sens_buff_drain], fis_geom.buff_len, spp, pairs, fis_settle_tol);
+    }
+    else{
+        points = fis_settle_points;
+    }
+    if(points > max){ points = max; }
+    fis_settle_discarded += (unsigned long)points*spp;
+    return points;
+}
+
 BOOL fis_isReadyToExecute(void) {
     if( !(fis_signal_period > 0  && fis_rounds > 0 && fis_seed_is_set == TRUE)) {
         return FALSE;
@@ -221,7 +906,7 @@ BOOL fis_isReadyToExecute(void) {
         
     int normal_wait;
 
-    if(fis_state == FIS_STATE_DONE){
+    if(fis_state == FIS_STATE_DONE && !fis_sens_buff_isFull()){
     #if _FISICA_VERBOSE_ITERATE > 0
         printf("    expFis completed\n");
     #endif
@@ -242,13 +927,19 @@ BOOL fis_isReadyToExecute(void) {
             printf("    ADC period = %u\n", fis_signal_period);
             printf("    round = %u/%u\n",fis_current_round+1, fis_rounds);
             printf("    seed[%u] = %u\n",fis_current_round, seed[fis_current_round]);
-            printf("    fis_points = %u/%u\n",fis_point, FIS_SIGNAL_POINTS);
-            printf("    fis_samples = %u/%u\n",fis_sample, FIS_SIGNAL_SAMPLES);
-            printf("    samples per point = %u\n", FIS_SAMPLES_PER_POINT);
-            printf("    total samples (ADC) = %u\n", FIS_SIGNAL_SAMPLES);
-            printf("    len( sens_buff ) = %u\n", FIS_SENS_BUFF_LEN);
+            printf("    fis_points = %u/%u\n",fis_point, fis_geom.signal_points);
+            printf("    fis_samples = %u/%u\n",fis_sample, fis_signal_samples);
+            printf("    samples per point = %u\n", fis_geom.samples_per_point);
+            printf("    total samples (ADC) = %u\n", fis_signal_samples);
+            printf("    len( sens_buff ) = %u\n", fis_geom.buff_len);
         #endif
-        fis_run(fis_signal_period);
+        fis_dac_table_restart();
+        fis_dac_table_fill();
+        if(fis_armed == FALSE){
+            fis_arm(fis_signal_period);
+        }
+        fis_state = FIS_STATE_WORKING;
+        fis_Timer45_begin();
 
     }
     else if(fis_state == FIS_STATE_WAITING){    //expFis is wating to resume its execution
@@ -257,11 +948,11 @@ BOOL fis_isReadyToExecute(void) {
             printf("    ADC period = %u\n", fis_signal_period);
             printf("    round = %u/%u\n",fis_current_round+1, fis_rounds);
             printf("    seed[%u] = %u\n",fis_current_round, seed[fis_current_round]);
-            printf("    fis_points = %u/%u\n",fis_point, FIS_SIGNAL_POINTS);
-            printf("    fis_samples = %u/%u\n",fis_sample, FIS_SIGNAL_SAMPLES);
-            printf("    samples per point = %u\n", FIS_SAMPLES_PER_POINT);
-            printf("    total samples (ADC) = %u\n", FIS_SIGNAL_SAMPLES);
-            printf("    len( sens_buff ) = %u\n", FIS_SENS_BUFF_LEN);
+            printf("    fis_points = %u/%u\n",fis_point, fis_geom.signal_points);
+            printf("    fis_samples = %u/%u\n",fis_sample, fis_signal_samples);
+            printf("    samples per point = %u\n", fis_geom.samples_per_point);
+            printf("    total samples (ADC) = %u\n", fis_signal_samples);
+            printf("    len( sens_buff ) = %u\n", fis_geom.buff_len);
             //printf("    T4CONbits.TON %X\n",T4CONbits.TON);
             //printf("    T4CONbits.TON %X\n",T4CONbits.TON);
             //printf("    IEC1bits.T4IE %X\n",IEC1bits.T4IE);
@@ -269,7 +960,20 @@ BOOL fis_isReadyToExecute(void) {
             //printf("    IFS1bits.T4IF %X\n",IFS1bits.T4IF);
             //printf("    IFS1bits.T5IF %X\n",IFS1bits.T5IF);
         #endif
-        fis_iterate_resume();
+        if(sens_buff_ready < FIS_SENS_BUFF_NUM){
+            fis_dac_table_restart();    //burn-in of the next point, whatever was played before
+            fis_dac_table_fill();
+            fis_iterate_resume();
+        }
+    }
+    else if(fis_state == FIS_STATE_WORKING || fis_state == FIS_STATE_DONE){
+        //gapless acquisition (or the last sens_buff is still pending), just wait
+        #if _FISICA_VERBOSE_ITERATE > 0
+            printf("    expFis running, sens_buff ready = %u\n", sens_buff_ready);
+        #endif
+        if(fis_state == FIS_STATE_WORKING){
+            fis_dac_table_fill();   //next block of DAC codes, while the previous one plays out
+        }
     }
     else{
         #if _FISICA_VERBOSE_ITERATE > 0
@@ -284,7 +988,7 @@ BOOL fis_isReadyToExecute(void) {
     if( normal_wait == 1 ){   
 
             *rc = 0;
-        if(fis_state == FIS_STATE_DONE) {
+        if(fis_state == FIS_STATE_DONE && sens_buff_ready == 1) {
             *rc = 1;
         }
     }
@@ -359,53 +1063,101 @@ void fis_testDAC(unsigned int value){
     #endif
 
     unsigned int temp;
+    fis_dac_spi_fast(TRUE);
     for(temp=0;temp < value; temp++){
         fis_payload_writeDAC(temp);
     }
+    fis_dac_spi_fast(FALSE);
     #if _FISICA_VERBOSE_DAC_SPI > 0
         printf("    Ok\n");
     #endif
 }
+/*
+ * Prints the DAC codes of the signal_points measured points of the first
+ * round of a seed, with the current waveform. For FIS_WAVE_UNIFORM the ground
+ * can compute the same values with fisRng.m
+ */
 void fis_payload_print_seed(unsigned int seedValue){
     printf("    fis_payload_print_seed %d...\n", seedValue);
     fis_seed_init(seedValue);
-    printf("    srand is set, printing random values ...\n");
-    unsigned int value = 0;
-    unsigned int i,j,k;
-    unsigned int totalRounds = FIS_SIGNAL_SAMPLES / FIS_SENS_BUFF_LEN;
-    unsigned int dacPoints = FIS_SENS_BUFF_LEN / FIS_SAMPLES_PER_POINT;
-    for(i = 0; i < totalRounds; i++) {
-        for (j = 0; j < FIS_POINTS_INB4; j++) {
-            value = fisRand();
-        }
-        for(k = 0; k < dacPoints; k++) {
-            printf("    rand() = %u \n",fisRand());
-        }
+    printf("    seed is set, printing random values ...\n");
+    unsigned long k;
+    for(k = 0; k < fis_geom.signal_points; k++) {
+        printf("    rand() = %u \n", fis_stimulus(k));
     }
 }
 
+/*
+ * As fis_payload_print_seed, but begins with the points_inb4 burn-in
+ * points played before the first measured point. A resume before point k
+ * replays the points_inb4 codes before k of this same sequence
+ */
 void fis_payload_print_seed_full(unsigned int seedValue){
     printf("    fis_payload_print_seed_full %d...\n", seedValue);
     fis_seed_init(seedValue);
-    printf("    srand is set, printing random values ...\n");
-    unsigned int i,j,k;
-    unsigned int totalRounds = FIS_SIGNAL_SAMPLES / FIS_SENS_BUFF_LEN;
-    unsigned int dacPoints = FIS_SENS_BUFF_LEN / FIS_SAMPLES_PER_POINT;
-    for(i = 0; i < totalRounds; i++) {
-        for (j = 0; j < FIS_POINTS_INB4; j++) {
-            printf("    rand() = %u \n",fisRand());
-        }
-        for(k = 0; k < dacPoints; k++) {
-            printf("    rand() = %u \n",fisRand());
+    printf("    seed is set, printing random values ...\n");
+    unsigned long k;
+    for(k = -(unsigned long)fis_geom.points_inb4; k != fis_geom.signal_points; k++) {
+        printf("    rand() = %u \n", fis_stimulus(k));
+    }
+}
+
+/*
+ * Waits for the DAC frame being sent, ends it (SPI_nSS_3 high, the DAC
+ * latches the value) and drops the bytes received meanwhile
+ */
+static inline void fis_dac_spi_finish(void){
+    if(fis_dac_pending){
+        while(SPI3STATbits.SPIBEC != 0 || !SPI3STATbits.SRMPT);
+        SPI_nSS_3 = 1;  //SPI: Slave Select PIN inactive
+        while(!SPI3STATbits.SRXMPT){
+            (void)SPI3BUF;
         }
+        SPI3STATbits.SPIROV = 0;
+        fis_dac_pending = FALSE;
     }
 }
 
+/*
+ * Turns on/off the fast DAC path. With it on, fis_payload_writeDAC queues the
+ * 24 bits frame in the SPI3 enhanced buffer (FIFO) and returns while it is
+ * sent, the frame is ended at the next write or when turning it off. Turn it
+ * off before SPI3 is used by SPI_3_transfer (other devices)
+ * @param on TRUE to use the enhanced buffer
+ */
+void fis_dac_spi_fast(BOOL on){
+    #if FIS_DAC_SPI_FAST
+        fis_dac_spi_finish();
+        if(on == fis_dac_fast){ return; }
+        SPI3STATbits.SPIEN = 0;     //SPIBEN can only be changed with the module off
+        SPI3CON2bits.SPIBEN = on;
+        SPI3STATbits.SPIEN = 1;
+        fis_dac_fast = on;
+    #endif
+}
+
+/*
+ * Fast path of fis_payload_writeDAC: 3 bytes into the SPI3 FIFO, no waiting
+ * for the previous frame unless it is still being sent
+ */
+static inline void fis_dac_spi_write(unsigned int arg){
+    fis_dac_spi_finish();
+    SPI_nSS_3 = 0;  //SPI: Slave Select PIN active
+    SPI3BUF = 0x00;
+    SPI3BUF = (arg >> 8) & 0x00FF;
+    SPI3BUF = arg & 0x00FF;
+    fis_dac_pending = TRUE;
+}
 
 /*
  * Writes a Digital value in the input Port of this Payload, using the DAC
  */
 void fis_payload_writeDAC(unsigned int arg){
+    if(fis_dac_fast){
+        fis_dac_spi_write(arg);
+        return;
+    }
+
     unsigned char r, firstByte, secondByte,thirdByte;
     //Bytes to be written in the SPI register
     unsigned int myarg = arg;
@@ -433,14 +1185,17 @@ void fis_payload_writeDAC(unsigned int arg){
 void fis_iterate_stop(void){
     
     T4CONbits.TON = 0;
-    T5CONbits.TON = 0;
     IEC1bits.T4IE = 0;
-    IEC1bits.T5IE = 0;
+    fis_ADC_clock_enable(FALSE);
+    fis_dac_spi_fast(FALSE);
 
     #if (_FISICA_VERBOSE_ITERATE > 0)
         printf("expFis ISRs are down ...\r\n");
     #endif
     CloseADC10();
+    T2CONbits.TON = 0;
+    IEC0bits.T2IE = 0;
+    fis_armed = FALSE;
     
     #if (_FISICA_VERBOSE_ITERATE > 0)
         printf("expFis ADC is closed ...\r\n");
@@ -455,17 +1210,20 @@ void fis_iterate_stop(void){
 void fis_iterate_pause(void){
     fis_state = FIS_STATE_WAITING;
     T4CONbits.TON = 0;
-    T5CONbits.TON = 0;
     IEC1bits.T4IE = 0;
-    IEC1bits.T5IE = 0;
+    fis_ADC_clock_enable(FALSE);
+    fis_isr_run_cycles += fis_clock_read() - fis_isr_run_start;
 
-    fis_payload_writeDAC(meanValue);
+    if(fis_profile_flags & FIS_PROFILE_PARK_DAC){
+        fis_payload_writeDAC(meanValue);
+    }
+    fis_dac_spi_fast(FALSE);    //SPI3 back to normal between buffers
     
     #if _FISICA_VERBOSE_ITERATE > 0
         printf("fis_pause_expFis\n");
 
     #endif
-    if(fis_sample == FIS_SIGNAL_SAMPLES) {
+    if(fis_sample == fis_signal_samples) {
         fis_sample = 0;
         if((fis_current_round) == fis_rounds) {
             fis_iterate_stop();  
@@ -473,27 +1231,44 @@ void fis_iterate_pause(void){
     }
 }
 /*  
- * Use only saving the data inside sens_buff into the Data Repository
+ * Use only saving the data inside sens_buff into the Data Repository.
+ * The ADC and the timers keep the configuration of fis_arm, so only the
+ * counters and the TON/IE bits are touched here
  */
 void fis_iterate_resume(void){
     sync = FALSE;
-    beginValidPoints = FALSE;
+    beginValidPoints = (fis_geom.points_inb4 == 0)? TRUE : FALSE;
     sens_buff_ind = 0;
     fis_aux_points = 0;
-    T4CONbits.TON = 1;
-    T5CONbits.TON = 1;
-    IEC1bits.T4IE = 1;
-    IEC1bits.T5IE = 1;
+    fis_point = fis_sample/fis_geom.samples_per_point;    //next point to be measured
+    fis_resumes++;
+    fis_after_resume = TRUE;
+    if(fis_armed == FALSE){
+        fis_arm(fis_signal_period);     //the ADC was closed or the period changed
+    }
     fis_state = FIS_STATE_WORKING;
+    fis_Timer45_begin();
     #if _FISICA_VERBOSE_ITERATE > 0
         printf("fis_iterate_resume ok\n");
     #endif
-    fis_run(fis_signal_period);
-
 }
 
 void fis_run(const unsigned int period){
-    unsigned int period_DAC = period*(FIS_SAMPLES_PER_POINT);
+    fis_arm(period);
+    fis_state = FIS_STATE_WORKING;
+    fis_Timer45_begin();
+}
+
+/*
+ * Configures the ADC and the timers of the current fis_adc_mode for one
+ * ADC period, with the timers and their interruptions stopped. Done once per
+ * run (or when the period or the mode changes), fis_Timer45_begin starts them
+ */
+void fis_arm(const unsigned int period){
+    //a timer period is PR+1 counts, and in FIS_ADC_HW_DUAL mode a sample is
+    //two Timer3 periods (AN11 and AN13)
+    unsigned int sample_counts = (fis_adc_mode == FIS_ADC_HW_DUAL)? 2*((period >> 1)+1) : period+1;
+    unsigned int period_DAC = sample_counts*fis_geom.samples_per_point - 1;
     unsigned int period_ADC = period;    
     #if (_FISICA_VERBOSE_ITERATE > 0)
         printf("ADC_period (DAC_period=3*ADC_period) = %u\n", period);
@@ -501,22 +1276,64 @@ void fis_run(const unsigned int period){
         printf("period ADC= %u\n", period_ADC);
     #endif
     fis_ADC_config();   //configura los registros del ADC
-    fis_Timer4_config(period_DAC);  //DAC
-    fis_Timer5_config(period_ADC);  //ADC
-    fis_state = FIS_STATE_WORKING;
+    if(fis_timing == FIS_TIMING_SEPARATE){
+        fis_Timer4_config(period_DAC);  //DAC
+    }
+    else{
+        T4CONbits.TON = 0;  //DAC updated by the ADC ISR
+        if(fis_dac_phase > period_ADC){
+            fis_dac_phase = period_ADC;     //TMR5 never goes beyond PR5
+        }
+    }
+    fis_conv_delayed = (fis_adc_mode == FIS_ADC_SOFT_TRIGGER && fis_timing == FIS_TIMING_LOCKED
+            && fis_dac_phase > 0)? TRUE : FALSE;
+    if(fis_adc_mode == FIS_ADC_SOFT_TRIGGER){
+        fis_Timer5_config(period_ADC);  //ADC, conversion started by the T5 ISR
+        if(fis_conv_delayed){
+            //one-shot of phase counts from each T5 tick, started by the T5 ISR
+            fis_Timer3_config(fis_dac_phase);
+            IPC2bits.T3IP = FIS_ISR_IPL;
+        }
+    }
+    else if(fis_adc_mode == FIS_ADC_HW_DUAL){
+        //two conversions (AN11 and AN13) per sample, same number of samples per point
+        fis_Timer3_config(period_ADC >> 1);
+    }
+    else{
+        fis_Timer3_config(period_ADC);  //ADC, conversion started by Timer3 itself
+    }
+    IEC1bits.T4IE = 0;  //until fis_Timer45_begin
+    fis_ADC_clock_enable(FALSE);
+    fis_clock_config();
+    fis_armed = TRUE;
     #if (_FISICA_VERBOSE_ITERATE > 0)
-        printf("expFis ISRs are up..\r\n");
+        printf("expFis ADC and timers armed..\r\n");
     #endif
-    fis_Timer45_begin();
 }
 
 /* 
- * Begin the timer counter
- * 
+ * Begin the timer counter (Timer4 and the ADC clock, Timer5 or Timer3).
+ * The counters and flags left by the last pause are cleared first, so
+ * every start has the same phase between the DAC and the ADC
  */
 void fis_Timer45_begin(void){
-    T4CONbits.TON = 1;
-    T5CONbits.TON = 1;
+    int ipl;
+    TMR4 = 0;
+    TMR5 = 0;
+    TMR3 = 0;
+    IFS1bits.T4IF = 0;
+    IFS1bits.T5IF = 0;
+    IFS0bits.AD1IF = 0;
+    fis_dac_countdown = (fis_adc_mode == FIS_ADC_HW_BURST)? fis_geom.samples_per_point : 1;  //first tick updates the DAC
+    fis_isr_lock(ipl);  //the T2 ISR must not split the read
+    fis_isr_run_start = fis_clock_read();
+    fis_isr_unlock(ipl);
+    fis_dac_spi_fast(TRUE);
+    if(fis_timing == FIS_TIMING_SEPARATE){
+        IEC1bits.T4IE = 1;
+        T4CONbits.TON = 1;
+    }
+    fis_ADC_clock_enable(TRUE);
     #if _FISICA_VERBOSE_TIMER4_CFG > 0
         printf("fis_init_timers(): T4CON %X\n",T4CON);
         printf("fis_init_timers(): IFS1bits.T4IF %X\n",IFS1bits.T4IF);
@@ -555,15 +1372,27 @@ void fis_ADC_config(void){
      * config1 = 0x5c1f = 0b 0101 1100 0001 1111 
      * iwant   = 0x0004 = 0b 0000 0000 0000 01xx
      * AUTO_SAMPLING means that ADC is sampling all the time, 
-     * but conversion has to be set manually.
+     * but conversion has to be set manually (soft trigger) or by a Timer3
+     * compare (hardware trigger, ADC_CLK_TMR).
      * After a conversion occurs, a new sampling process begins automatically.
      */
-    config1 = ADC_MODULE_OFF & ADC_IDLE_CONTINUE & ADC_FORMAT_INTG & ADC_CLK_MANUAL & ADC_AUTO_SAMPLING_ON;
+    if(fis_adc_mode == FIS_ADC_SOFT_TRIGGER){
+        config1 = ADC_MODULE_OFF & ADC_IDLE_CONTINUE & ADC_FORMAT_INTG & ADC_CLK_MANUAL & ADC_AUTO_SAMPLING_ON;
+    }
+    else{
+        config1 = ADC_MODULE_OFF & ADC_IDLE_CONTINUE & ADC_FORMAT_INTG & ADC_CLK_TMR & ADC_AUTO_SAMPLING_ON;
+    }
     /* AD1CON2
      * config2 = 0x0F84 = 0b 0000 1111 1000 0000
      * i want  = 0x0400 = 0b 0000 0100 0000 0000
      */
-    config2 = ADC_VREF_AVDD_AVSS & ADC_SCAN_ON & ADC_INTR_EACH_CONV & ADC_ALT_BUF_OFF & ADC_ALT_INPUT_OFF;
+    if(fis_adc_mode == FIS_ADC_HW_BURST){
+        //only AN11, the SMPI field is set below to interrupt once per DAC point
+        config2 = ADC_VREF_AVDD_AVSS & ADC_SCAN_OFF & ADC_INTR_EACH_CONV & ADC_ALT_BUF_OFF & ADC_ALT_INPUT_OFF;
+    }
+    else{
+        config2 = ADC_VREF_AVDD_AVSS & ADC_SCAN_ON & ADC_INTR_EACH_CONV & ADC_ALT_BUF_OFF & ADC_ALT_INPUT_OFF;
+    }
     /* AD1CON3
      * AD1CON2bits.SMPI controla los flag de interrupciones en el registro AD1IF
      * El flag de interrupcion se setea despu?s de la cantidad de conversiones correspondientes
@@ -597,11 +1426,21 @@ void fis_ADC_config(void){
     AD1CHS0bits.CH0SA4= 0;
      //This function starts the A/D conversion and configures the ADC
     OpenADC10_v2(config1,config2,config3,configportL,configportH,configscanL,configscanH);
+    if(fis_adc_mode == FIS_ADC_HW_BURST){
+        //the samples_per_point conversions of a point go to ADC1BUF0..N
+        AD1CON2bits.SMPI = fis_geom.samples_per_point-1;
+    }
+    else if(fis_adc_mode == FIS_ADC_HW_DUAL){
+        //one interruption per scan: AN11 in ADC1BUF0, AN13 in ADC1BUF1
+        AD1CON2bits.SMPI = 1;
+    }
     EnableADC1; //set ADON to 0b1
-    /* no se usaran las interrupciones del ADC, por que se usaran los timers para esto.
-     * ConfigIntADC10(ADC_INT_DISABLE | ADC_INT_PRI_2 );   //Disable the interrup enable register IEC
+    /* En modo soft trigger no se usaran las interrupciones del ADC, por que se usaran
+     * los timers para esto. En modo hardware trigger el ADC ISR lee cada conversion,
+     * con la misma prioridad de los timers. Se habilita en fis_Timer45_begin
      */
-    IEC0bits.AD1IE = 0; //disable the ADC interrupts, cuz we'll not use it.
+    ConfigIntADC10(ADC_INT_DISABLE & ADC_INT_PRI_4);    //FIS_ISR_IPL
+    IEC0bits.AD1IE = 0; //disable the ADC interrupts until the timers are up
     IFS0bits.AD1IF = 0;   //clear the interrput flag for the ADC
     
     #if _FISICA_VERBOSE_ADC_CFG > 0
@@ -626,6 +1465,7 @@ void fis_Timer4_config(unsigned int period){    //CONFIGURAR EL POSTSCALER A 64
    
     WriteTimer4(0x0000);
     OpenTimer4( config, period );
+    IPC6bits.T4IP = FIS_ISR_IPL;
     EnableIntT4;
     #if _FISICA_VERBOSE_TIMER4_CFG > 0
         printf("t4_config configuration data\n");
@@ -645,6 +1485,27 @@ void fis_Timer4_config(unsigned int period){    //CONFIGURAR EL POSTSCALER A 64
     #endif
 }
 
+/*  
+ * Set the T3 control registers. Timer3 is the trigger source of the ADC in the
+ * hardware trigger mode, so its interruption is not used
+ * T3CON = T3_OFF & T3_GATE_OFF & T3_IDLE_CON & T3_PS_1_64 & T3_SOURCE_INT
+ */
+void fis_Timer3_config(unsigned int period){//CONFIGURAR EL POSTSCALER A 64
+    //                      7654321076543210
+    unsigned int config = 0b0000000000100000; //T3_OFF & T3_GATE_OFF & T3_IDLE_CON & T3_PS_1_64 & T3_SOURCE_INT;
+    WriteTimer3(0x0000);
+    OpenTimer3( config, period );
+    DisableIntT3;
+    #if _FISICA_VERBOSE_TIMER5_CFG > 0
+        printf("t3_config configuration data\n");
+        printf("IEC0bits.AD1IE: %u\n",IEC0bits.AD1IE);
+        printf("T3CON : %X\n",T3CON);
+        printf("TMR3 : %u\n",TMR3);
+        printf("PR3 : %u\n",PR3);
+        printf("t3_config done\n");
+    #endif
+}
+
 /*  
  * Set the T5 control registers and the interruption register as well
  * T5CON = T5_ON & T5_GATE_OFF & T5_IDLE_CON & T5_PS_1_64 & T5_SOURCE_INT
@@ -654,6 +1515,7 @@ void fis_Timer5_config(unsigned int period){//CONFIGURAR EL POSTSCALER A 64
     unsigned int config = 0b0000000000100000; //T5_ON & T5_GATE_OFF & T5_IDLE_CON & T5_PS_1_64 & T5_SOURCE_INT;
     WriteTimer5(0x0000);
     OpenTimer5( config, period );
+    IPC7bits.T5IP = FIS_ISR_IPL;
     EnableIntT5;
     #if _FISICA_VERBOSE_TIMER5_CFG > 0
         printf("t5_config configuration data\n");
@@ -673,28 +1535,118 @@ void fis_Timer5_config(unsigned int period){//CONFIGURAR EL POSTSCALER A 64
     #endif
 }
 
-/*  
- * DAC ISR
+static inline void fis_sens_buff_advance(unsigned int words, unsigned int samples);
+
+/*
+ * Stores one ADC sample in sens_buff and hands the buffer over when it is full.
+ * Shared by the ADC ISRs of every Fis_AdcModes
  */
-void __attribute__((__interrupt__, auto_psv)) _T4Interrupt(void){
-    #if _FISICA_VERBOSE_TIMER4_ISR > 0
-        printf("ISR T4\n");
-        #if _FISICA_VERBOSE_TIMER4_ISR >= 2
-            printf("IEC1bits.T4IE: %u\n",IEC1bits.T4IE);
-            printf("IEC1bits.T5IE: %u\n",IEC1bits.T5IE);
-            printf("IFS1bits.T4IF: %u\n", IFS1bits.T4IF);
-            printf("IFS1bits.T5IF: %u\n",IFS1bits.T5IF);
-            printf("IPC6bits.T4IP: %X\n",IPC6bits.T4IP);
-            printf("IPC6bits.T5IP: %X\n",IPC7bits.T5IP);
-            printf("T4CON : %X\n",T4CON);
-            printf("T5CON : %X\n",T5CON);
-            printf("TMR4 : %u\n",TMR4);
-            printf("TMR5 : %u\n",TMR5);
-            printf("PR4 : %u\n",PR4);
-            printf("PR5 : %u\n",PR5);
-        #endif
+static inline void fis_sens_buff_store(unsigned int value){
+    if((sens_buff_ind % fis_geom.samples_per_point) == 0){
+        dac_buff[sens_buff_fill][sens_buff_ind / fis_geom.samples_per_point] = fis_dac_value;
+    }
+    sens_buff[sens_buff_fill][sens_buff_ind] = value;
+
+    #if _FISICA_VERBOSE_TIMER5_ISR > 0
+        printf("sens_buff[%d] = %X\n", sens_buff_ind, sens_buff[sens_buff_fill][sens_buff_ind]);
     #endif
-    BOOL   condition = (fis_point == FIS_SIGNAL_POINTS || sens_buff_ind == (FIS_SENS_BUFF_LEN)) && sync;
+
+    fis_sens_buff_advance(1, 1);
+}
+
+/*
+ * Copies the samples_per_point conversions of one DAC point from
+ * ADC1BUF0..N into sens_buff. buff_len is a multiple of samples_per_point
+ * (fis_check_geometry), so a point never falls between two sens_buff
+ */
+static inline void fis_sens_buff_store_point(void){
+    unsigned int *dst = &sens_buff[sens_buff_fill][sens_buff_ind];
+    unsigned int i;
+    unsigned int spp = fis_geom.samples_per_point;
+    dac_buff[sens_buff_fill][sens_buff_ind / spp] = fis_dac_value;
+    for(i = 0; i < spp; i++){
+        dst[i] = ReadADC10(i);
+    }
+    fis_sens_buff_advance(spp, spp);
+}
+
+/*
+ * Stores the (Vout, Vin) pair of one scan: AN11 (circuit output) and AN13
+ * (DAC readback). A point takes 2*samples_per_point words of sens_buff
+ */
+static inline void fis_sens_buff_store_pair(void){
+    if((sens_buff_ind % (2*fis_geom.samples_per_point)) == 0){
+        dac_buff[sens_buff_fill][sens_buff_ind / (2*fis_geom.samples_per_point)] = fis_dac_value;
+    }
+    sens_buff[sens_buff_fill][sens_buff_ind] = ReadADC10(0);
+    sens_buff[sens_buff_fill][sens_buff_ind+1] = ReadADC10(1);
+    fis_sens_buff_advance(2, 1);
+}
+
+/*
+ * Updates the counters after storing some words (samples of one or two
+ * channels) and hands the buffer over when it is full
+ */
+static inline void fis_sens_buff_advance(unsigned int words, unsigned int samples){
+    FIS_TimeCapture *t = &fis_time[sens_buff_fill];
+    BOOL timed = (fis_output & FIS_OUTPUT_TIME)? TRUE : FALSE;  //snapshots only if they are saved
+    unsigned long now = 0;
+    unsigned int tmr_adc = 0;
+    if(timed){
+        now = fis_clock_read();
+        tmr_adc = (fis_adc_mode == FIS_ADC_SOFT_TRIGGER)? TMR5 : TMR3;
+    }
+    if(sens_buff_ind == 0){
+        t->resumed = fis_after_resume;
+        fis_after_resume = FALSE;
+        if(timed){
+            t->buff = fis_time_buffs;
+            t->start = now;
+            t->tmr4_start = TMR4;
+            t->tmr_adc_start = tmr_adc;
+            t->nstamps = 0;
+            fis_time_left = 0;
+        }
+    }
+    if(timed && fis_time_every != 0){
+        if(fis_time_left < samples){
+            if(t->nstamps < FIS_TIME_MAX_STAMPS){
+                t->stamps[t->nstamps++] = now;
+            }
+            fis_time_left = fis_time_left + fis_time_every;
+        }
+        fis_time_left = fis_time_left - samples;
+    }
+
+    sens_buff_ind = sens_buff_ind+words;    //updates the index of the buffer
+    fis_sample = fis_sample+samples; //updates the global counter of samples
+
+    if(sens_buff_ind == fis_geom.buff_len){
+        #if _FISICA_VERBOSE_TIMER5_ISR > 0
+            printf("ISR ADC: sens_buff_ind == buff_len\r\n");
+        #endif
+        if(timed){
+            t->end = now;
+            t->tmr4_end = TMR4;
+            t->tmr_adc_end = tmr_adc;
+        }
+        fis_time_buffs++;
+        if(fis_sample == fis_signal_samples){
+            fis_current_round++;
+            // esta linea esta reseteando el rand asi que se borra
+            //srand(seed[fis_current_round]);
+        }
+        fis_sens_buff_swap(); //pauses only if the task is behind or the waveform is done
+    }
+}
+
+/*
+ * Plays the next DAC point and keeps the burn-in and point counters. Called by
+ * the Timer4 ISR (FIS_TIMING_SEPARATE) or every samples_per_point samples
+ * by the ADC ISR (FIS_TIMING_LOCKED)
+ */
+static inline void fis_dac_step(void){
+    BOOL   condition = (fis_point == fis_geom.signal_points || sens_buff_ind == fis_geom.buff_len) && sync;
     if(condition){ //last point of a waveform
         fis_point = 0;
         //printf("fis_current_round = %u\n", fis_current_round);
@@ -713,16 +1665,25 @@ void __attribute__((__interrupt__, auto_psv)) _T4Interrupt(void){
         //}
     }                
     else{//T4_Clear_Intr_Status_Bit;
-//        unsigned int arg = rand();
-        unsigned int arg = fisRand();
+        unsigned int arg;
+        if(fis_dac_count > 0){
+            arg = fis_dac_table[fis_dac_tail];
+            fis_dac_tail = (fis_dac_tail+1 == (unsigned int)FIS_DAC_TABLE_LEN)? 0 : fis_dac_tail+1;
+            fis_dac_count--;
+        }
+        else{
+            arg = fis_stimulus(fis_rng_next++);    //empty table, next code of the same sequence
+            fis_dac_underruns++;
+        }
         #if _FISICA_VERBOSE_TIMER4_ISR > 0
             printf("rand(): %X\n",arg);
         #endif
         fis_payload_writeDAC(arg);
+        fis_dac_value = arg;
         
         if(beginValidPoints == FALSE) {
             fis_aux_points++;
-            if(fis_aux_points == FIS_POINTS_INB4) {
+            if(fis_aux_points == fis_geom.points_inb4) {
                 beginValidPoints = TRUE;
                 fis_aux_points = 0;
             }
@@ -732,11 +1693,92 @@ void __attribute__((__interrupt__, auto_psv)) _T4Interrupt(void){
             fis_point++;
         }
     }
+}
+
+/*
+ * FIS_TIMING_LOCKED: counts the ADC samples and updates the DAC every
+ * samples_per_point of them, so the samples of a point are always at the
+ * same phase of the DAC step
+ * @param samples Samples taken since the last call
+ */
+static inline void fis_dac_tick(unsigned int samples){
+    fis_dac_countdown = fis_dac_countdown - samples;
+    if(fis_dac_countdown == 0){
+        fis_dac_countdown = fis_geom.samples_per_point;
+        fis_dac_step();
+    }
+}
+
+/*  
+ * DAC ISR
+ */
+void __attribute__((__interrupt__, auto_psv)) _T4Interrupt(void){
+    #if FIS_ISR_STATS
+        unsigned int isr_t0 = TMR2;
+        unsigned int isr_tmr = TMR4;
+    #endif
+    #if _FISICA_VERBOSE_TIMER4_ISR > 0
+        printf("ISR T4\n");
+        #if _FISICA_VERBOSE_TIMER4_ISR >= 2
+            printf("IEC1bits.T4IE: %u\n",IEC1bits.T4IE);
+            printf("IEC1bits.T5IE: %u\n",IEC1bits.T5IE);
+            printf("IFS1bits.T4IF: %u\n", IFS1bits.T4IF);
+            printf("IFS1bits.T5IF: %u\n",IFS1bits.T5IF);
+            printf("IPC6bits.T4IP: %X\n",IPC6bits.T4IP);
+            printf("IPC6bits.T5IP: %X\n",IPC7bits.T5IP);
+            printf("T4CON : %X\n",T4CON);
+            printf("T5CON : %X\n",T5CON);
+            printf("TMR4 : %u\n",TMR4);
+            printf("TMR5 : %u\n",TMR5);
+            printf("PR4 : %u\n",PR4);
+            printf("PR5 : %u\n",PR5);
+        #endif
+    #endif
+    fis_dac_step();
+    #if FIS_ISR_STATS
+        fis_isr_stats_add(&fis_isr_stats[FIS_ISR_T4], isr_tmr, isr_t0, PR4);
+    #endif
     IFS1bits.T4IF = 0;
 }
 
+/*
+ * Software interrupt of fis_sens_buff_swap, at the kernel priority so it can
+ * give fis_sem_buff. The waiting task runs at the next tick, no yield here
+ */
+void __attribute__((__interrupt__, auto_psv)) _CRCInterrupt(void){
+    portBASE_TYPE task_woken = pdFALSE;
+    IFS4bits.CRCIF = 0;
+    if(fis_sem_buff != NULL){
+        xSemaphoreGiveFromISR(fis_sem_buff, &task_woken);
+    }
+}
+
+/*
+ * Timer2 clock overflow
+ */
+void __attribute__((__interrupt__, auto_psv)) _T2Interrupt(void){
+    fis_clock_hi++;
+    IFS0bits.T2IF = 0;
+}
+
+/*
+ * Converts and stores one sample, soft trigger mode
+ */
+static inline void fis_adc_convert_store(void){
+    ConvertADC10(); //stop sampling and begins the conversion
+    while(!AD1CON1bits.DONE);
+    fis_sens_buff_store(ReadADC10(0));
+}
+
 // ADC ISR
 void __attribute__((__interrupt__, auto_psv)) _T5Interrupt(void){
+    #if FIS_ISR_STATS
+        unsigned int isr_t0 = TMR2;
+        unsigned int isr_tmr = TMR5;
+    #endif
+    if(fis_timing == FIS_TIMING_LOCKED){
+        fis_dac_tick(1);    //the DAC is updated at the tick, before the conversion
+    }
     if (sync == TRUE){
         #if _FISICA_VERBOSE_TIMER5_ISR > 0
             printf("ISR T5\n");
@@ -757,29 +1799,70 @@ void __attribute__((__interrupt__, auto_psv)) _T5Interrupt(void){
             #endif
         #endif
 
-        ConvertADC10(); //stop sampling and begins the conversion
-        while(!AD1CON1bits.DONE);
-        sens_buff[sens_buff_ind] = ReadADC10(0);
-        
-        #if _FISICA_VERBOSE_TIMER5_ISR > 0
-            printf("sens_buff[%d] = %X\n", sens_buff_ind, sens_buff[sens_buff_ind]);
-        #endif
-    
-        sens_buff_ind = sens_buff_ind+1;    //updates the index of the buffer
-        fis_sample = fis_sample+1; //updates the global counter of samples
-        
-        if(sens_buff_ind == (FIS_SENS_BUFF_LEN)){ 
-            #if _FISICA_VERBOSE_TIMER5_ISR > 0
-                printf("ISR T5: sens_buff_ind == FIS_SENS_BUFF_LEN\r\n");
-            #endif
-            //sens_buff_ind = 0;
-            if(fis_sample == FIS_SIGNAL_SAMPLES){
-                fis_current_round++;
-                // esta linea esta reseteando el rand asi que se borra
-                //srand(seed[fis_current_round]);
-            }
-            fis_iterate_pause(); //there are some work to do, we make a pause only
+        if(fis_conv_delayed && TMR5 < fis_dac_phase){
+            //Timer3 counts from where TMR5 is and ends at phase, the
+            //conversion is done by _T3Interrupt
+            TMR3 = TMR5;
+            T3CONbits.TON = 1;
+        }
+        else{
+            fis_adc_convert_store();
         }
     }
+    #if FIS_ISR_STATS
+        fis_isr_stats_add(&fis_isr_stats[FIS_ISR_T5], isr_tmr, isr_t0, PR5);
+    #endif
     IFS1bits.T5IF = 0;
+}
+
+/*
+ * FIS_TIMING_LOCKED soft trigger: phase counts after the T5 tick that
+ * updated the DAC
+ */
+void __attribute__((__interrupt__, auto_psv)) _T3Interrupt(void){
+    #if FIS_ISR_STATS
+        unsigned int isr_t0 = TMR2;
+        unsigned int isr_tmr = TMR3;
+    #endif
+    T3CONbits.TON = 0;
+    TMR3 = 0;
+    fis_adc_convert_store();
+    #if FIS_ISR_STATS
+        //one-shot, its deadline is the next T5 tick
+        fis_isr_stats_add(&fis_isr_stats[FIS_ISR_T3], isr_tmr, isr_t0, PR5);
+    #endif
+    IFS0bits.T3IF = 0;
+}
+
+/*
+ * ADC ISR (hardware trigger modes). Timer3 already started the conversions, so
+ * the results are ready and nobody busy-waits. In FIS_ADC_HW_BURST mode there
+ * is one interruption per DAC point instead of one per sample, and in
+ * FIS_ADC_HW_DUAL mode one per (Vout, Vin) pair
+ */
+void __attribute__((__interrupt__, auto_psv)) _ADC1Interrupt(void){
+    #if FIS_ISR_STATS
+        unsigned int isr_t0 = TMR2;
+        unsigned int isr_tmr = TMR3;
+    #endif
+    if (sync == TRUE){
+        if(fis_adc_mode == FIS_ADC_HW_BURST){
+            fis_sens_buff_store_point();
+        }
+        else if(fis_adc_mode == FIS_ADC_HW_DUAL){
+            fis_sens_buff_store_pair();
+        }
+        else{
+            fis_sens_buff_store(ReadADC10(0));
+        }
+    }
+    //the sample of this tick was converted before the DAC update, which
+    //leads the first sample of the next point by one ADC period
+    if(fis_timing == FIS_TIMING_LOCKED && fis_state == FIS_STATE_WORKING){
+        fis_dac_tick((fis_adc_mode == FIS_ADC_HW_BURST)? fis_geom.samples_per_point : 1);
+    }
+    #if FIS_ISR_STATS
+        fis_isr_stats_add(&fis_isr_stats[FIS_ISR_ADC], isr_tmr, isr_t0, PR3);
+    #endif
+    IFS0bits.AD1IF = 0;
 }
\ No newline at end of file
@@ -10,6 +10,10 @@
 
 // comand verbose
 #define FIS_CMD_VERBOSE (1)
+// latency, duration and load counters of the expFis ISRs (fis_isr_get_record)
+#define FIS_ISR_STATS (0)
+// DAC writes through the SPI3 enhanced buffer while the experiment runs
+#define FIS_DAC_SPI_FAST (1)
 
 // expFis variables
 #define FIS_STATE_OFF   (0)
@@ -18,12 +22,85 @@
 #define FIS_STATE_WORKING   (3)
 #define FIS_STATE_DONE (4)
 
+/*
+ * Default experiment geometry (FIS_Geometry). FIS_SENS_BUFF_LEN,
+ * FIS_SENS_BUFF_POINTS and FIS_POINTS_INB4 are also the size of the buffers in
+ * RAM, so they bound the geometry set with fis_set_geometry
+ */
 #define FIS_SIGNAL_POINTS (16000L)
 #define FIS_SAMPLES_PER_POINT (4L)
 #define FIS_SIGNAL_SAMPLES ((unsigned int)(FIS_SIGNAL_POINTS)*(FIS_SAMPLES_PER_POINT))
 #define FIS_SENS_BUFF_LEN (400L)
+//number of sens_buff used as ping-pong buffers (1 = pause on every full buffer)
+#define FIS_SENS_BUFF_NUM (2L)
+//number of DAC points inside one sens_buff
+#define FIS_SENS_BUFF_POINTS ((FIS_SENS_BUFF_LEN)/(FIS_SAMPLES_PER_POINT))
 #define FIS_POINTS_INB4 (500L)
-#define fisRand()   ((rand())<<(1))
+//largest samples_per_point (size of ADC1BUF, FIS_ADC_HW_BURST)
+#define FIS_SAMPLES_PER_POINT_MAX (16)
+//shortest waveform (FIS_WAVE_CHIRP segments)
+#define FIS_SIGNAL_POINTS_MIN (128)
+//DAC codes generated ahead of the Timer4 ISR: the burn-in plus one sens_buff of points
+#define FIS_DAC_TABLE_LEN ((FIS_POINTS_INB4)+(FIS_SENS_BUFF_POINTS))
+
+// data saved by pay_exec_expFis into dat_pay_expFis (mask)
+#define FIS_OUTPUT_RAW      (0x0001)    //every ADC sample
+#define FIS_OUTPUT_STATS    (0x0002)    //one statistics summary record per run (fis_stats.h)
+#define FIS_OUTPUT_HIST     (0x0004)    //one histogram record per run (fis_stats.h)
+#define FIS_OUTPUT_COMP     (0x0008)    //every ADC sample, one compressed block per sens_buff (fis_comp.h)
+#define FIS_OUTPUT_TIME     (0x0010)    //one timing record per sens_buff (fis_time_get_record)
+
+/*
+ * Timing record of a sens_buff, in Tcy counts of the free running Timer2 clock
+ * | word  | content                                                    |
+ * | 0     | FIS_TIME_RECORD_ID                                         |
+ * | 1-2   | adcPeriod, seed                                            |
+ * | 3     | number of the sens_buff in the run (0, 1, ...)             |
+ * | 4     | samples in the sens_buff                                   |
+ * | 5     | samples between stamps (0 = no stamps)                     |
+ * | 6-7   | clock at the first sample (long, low word first)           |
+ * | 8-9   | clock at the last sample                                   |
+ * | 10-11 | TMR4 and the ADC timer (TMR5 or TMR3) at the first sample  |
+ * | 12-13 | TMR4 and the ADC timer at the last sample                  |
+ * | 14    | n = number of stamps                                       |
+ * | 15-   | n clocks (long) of the samples 0, every, 2*every ...       |
+ * The clocks are taken by the ADC ISR right after storing each sample
+ */
+/*
+ * Geometry record of a run
+ * | word  | content                                                    |
+ * | 0     | FIS_GEOM_RECORD_ID                                         |
+ * | 1-2   | adcPeriod, seed                                            |
+ * | 3     | rounds                                                     |
+ * | 4-7   | signal_points, samples_per_point, buff_len, points_inb4    |
+ * | 8     | mission profile, see Fis_Profiles                          |
+ * | 9     | profile flags, FIS_PROFILE_xxx mask                        |
+ * | 10    | reduction of the raw samples, see Fis_Reductions           |
+ * | 11    | transient rejection, as in fis_set_settle (tol << 12 | points) |
+ * | 12-13 | samples discarded as transient in the run (long)           |
+ */
+#define FIS_GEOM_RECORD_ID  (0x6E03)
+#define FIS_GEOM_RECORD_LEN (14)
+
+#define FIS_TIME_RECORD_ID  (0x71ED)
+#define FIS_TIME_MAX_STAMPS (8L)
+#define FIS_TIME_RECORD_LEN (15 + 2*FIS_TIME_MAX_STAMPS)
+
+/*
+ * ISR statistics of a run, one block per Fis_Isrs. Times in Tcy, latency with
+ * the resolution of the 1:64 timer prescaler, loads in 1/1000 of the time
+ * the acquisition was running. The latency of FIS_ISR_ADC is trigger to ISR:
+ * it counts from the Timer3 match, so it includes the conversions
+ * | word  | content                                                    |
+ * | 0     | FIS_ISR_RECORD_ID                                          |
+ * | 1-2   | adcPeriod, seed                                            |
+ * | 3-4   | Tcy the acquisition was running (long, low word first)     |
+ * | 5     | load of all the ISRs                                       |
+ * | 6-    | per ISR: calls (long), latency min, max, mean,             |
+ * |       | duration min, max, mean, missed deadlines, load            |
+ */
+#define FIS_ISR_RECORD_ID   (0x15B0)
+#define FIS_ISR_BLOCK_LEN   (10)
 
 unsigned int fis_get_total_number_of_samples(void);
 unsigned int fis_get_sens_buff_size(void);
@@ -32,6 +109,87 @@ int fis_wait_busy_wtimeout(unsigned int timeout);
 void fis_print_sens_buff(void);
 void fis_sens_buff_reset(void);
 unsigned int fis_get_sens_buff_i(int ind);
+const unsigned int* fis_get_sens_buff(void);
+const unsigned int* fis_get_dac_buff(void);
+void fis_sens_buff_release(void);
+unsigned int fis_get_resume_count(void);
+void fis_dac_table_fill(void);
+
+/**
+ * Counter-based generator of the expFis stimulus. The DAC code of point n is
+ * a pure function of (seed, n), so any point is computed without playing the
+ * ones before it. Point k of round r is n = r*FIS_SIGNAL_POINTS + k (mod 2^32),
+ * the burn-in before it plays the points k-FIS_POINTS_INB4 .. k-1.
+ *
+ * x = n ^ (seed * 0x9E3779B9), then the murmur3 fmix32 finalizer:
+ * x ^= x >> 16; x *= 0x85EBCA6B; x ^= x >> 13; x *= 0xC2B2AE35; x ^= x >> 16
+ * (all mod 2^32) and the code is x >> 16. Ground reference: fisRng.m
+ *
+ * @param seed Seed of the experiment (pay_set_seed_expFis)
+ * @param n Point counter
+ * @return 16 bits DAC code
+ */
+unsigned int fis_rng(unsigned int seed, unsigned long n);
+
+/**
+ * Size of the experiment. Uplinked with pay_set_geometry_expFis, it can change
+ * between runs without reflashing
+ */
+typedef struct{
+    unsigned int signal_points;     ///< measured points of each waveform (round)
+    unsigned int samples_per_point; ///< ADC samples of each DAC point (oversampling)
+    unsigned int buff_len;          ///< words of a sens_buff (two per sample in FIS_ADC_HW_DUAL)
+    unsigned int points_inb4;       ///< burn-in points played before the first measured one, 0 = none
+} FIS_Geometry;
+
+/**
+ * Sets the geometry of the next runs. It is checked against the RAM buffers
+ * (FIS_SENS_BUFF_LEN, FIS_SENS_BUFF_POINTS, FIS_POINTS_INB4), the ADC
+ * (FIS_SAMPLES_PER_POINT_MAX) and the 16 bits sample counter and Data
+ * Repository index (signal_points*samples_per_point <= 0xFFFF). A waveform
+ * must fill a whole number of sens_buff, and a sens_buff a whole number of
+ * points (of pairs, for FIS_ADC_HW_DUAL)
+ * @param g New geometry
+ * @return TRUE if it was valid and set, FALSE if the geometry did not change
+ */
+BOOL fis_set_geometry(const FIS_Geometry *g);
+BOOL fis_check_geometry(const FIS_Geometry *g);
+const FIS_Geometry* fis_get_geometry(void);
+unsigned int fis_geom_get_record(unsigned int *rec);
+
+//profile flags
+#define FIS_PROFILE_PARK_DAC    (0x0001)    //DAC at meanValue while the acquisition is paused
+#define FIS_PROFILE_ROUND_SEED  (0x0002)    //round r plays the stimulus of seed+r from its point 0 (SUCHAI 1 srand(seed[r]))
+
+/**
+ * Behaviours that differ between the SUCHAI 1 flight software and SUCHAI 2/3.
+ * Both missions run this engine and command set, the profile picks them
+ */
+typedef struct{
+    FIS_Geometry geom;      ///< points_inb4 = 0 disables the burn-in
+    unsigned int flags;     ///< FIS_PROFILE_xxx mask
+    unsigned int adc_mode;  ///< one of Fis_AdcModes
+    unsigned int timing;    ///< one of Fis_Timings
+    unsigned int waveform;  ///< one of Fis_Waveforms
+} FIS_Profile;
+
+typedef enum{
+    FIS_PROFILE_SUCHAI23=0,  ///< burn-in, DAC parked on pause, one stimulus sequence for all the rounds
+    FIS_PROFILE_SUCHAI1,     ///< 1000 points, no burn-in, Timer4 and Timer5 apart, a new seed each round
+    FIS_PROFILE_LAST_ONE
+} Fis_Profiles;
+
+/**
+ * Selects the mission profile of the next runs. Sets the geometry, ADC mode,
+ * timing and waveform of the profile, which can be changed afterwards with
+ * their own functions
+ * @param profile One of Fis_Profiles
+ * @return TRUE if set, FALSE if expFis is running or the profile is invalid
+ */
+BOOL fis_set_profile(unsigned int profile);
+unsigned int fis_get_profile(void);
+unsigned int fis_get_profile_flags(void);
+unsigned int fis_get_dac_underrun_count(void);
 void fis_testDAC(unsigned int value);
 void fis_Timer45_begin(void);
 unsigned int fis_get_sens_buff_size(void);
@@ -45,6 +203,100 @@ unsigned int fis_get_state(void);
 BOOL fis_iterate_isComplete();
 unsigned int fis_set_seed(unsigned int seed, int rounds);
 unsigned int fis_set_adcPeriod(unsigned int inputSignalPeriod, int rounds);
+unsigned int fis_get_seed(void);
+unsigned int fis_get_adcPeriod(void);
+unsigned int fis_set_output(unsigned int output);
+unsigned int fis_get_output(void);
+/**
+ * Selects what FIS_OUTPUT_RAW and FIS_OUTPUT_COMP save of the samples of each
+ * DAC point (fis_reduce.h)
+ * @param mode One of Fis_Reductions
+ * @return the state of the payload
+ */
+unsigned int fis_set_reduce(unsigned int mode);
+unsigned int fis_get_reduce(void);
+/**
+ * Selects how many points are discarded at the beginning of each sens_buff
+ * filled right after a pause (or the start of the run), while the circuit
+ * settles. At most half a sens_buff is discarded
+ * @param points 0 = none, FIS_SETTLE_AUTO = found by fis_reduce_settle
+ * @param tol Tolerance of FIS_SETTLE_AUTO in ADC counts, 0 = FIS_SETTLE_TOL_DEFAULT,
+ * at most 15 (larger values are clamped)
+ */
+void fis_set_settle(unsigned int points, unsigned int tol);
+unsigned int fis_get_settle(void);
+/**
+ * Points to discard at the beginning of the sens_buff waiting to be saved.
+ * Adds them to the discarded count of the run, so call it once per sens_buff
+ * @return Number of whole points, 0 if the buffer did not follow a pause
+ */
+unsigned int fis_sens_buff_settle(void);
+
+/**
+ * How the ADC conversions are started
+ */
+typedef enum{
+    FIS_ADC_SOFT_TRIGGER=0,  ///< Timer5 ISR starts each conversion and waits for it
+    FIS_ADC_HW_TRIGGER,      ///< Timer3 starts each conversion, the ADC ISR reads it
+    FIS_ADC_HW_BURST,        ///< as HW_TRIGGER, but one ADC ISR per DAC point (SMPI)
+    FIS_ADC_HW_DUAL,         ///< Timer3 at half period converts AN11 (Vout) and AN13 (Vin), stored as pairs
+    FIS_ADC_LAST_ONE
+} Fis_AdcModes;
+
+unsigned int fis_set_adcMode(unsigned int mode);
+unsigned int fis_get_adcMode(void);
+unsigned int fis_set_waveform(unsigned int wave);
+unsigned int fis_get_waveform(void);
+
+/**
+ * What clocks the DAC updates
+ */
+typedef enum{
+    FIS_TIMING_SEPARATE=0,   ///< Timer4 at FIS_SAMPLES_PER_POINT ADC periods, started apart from the ADC clock
+    FIS_TIMING_LOCKED,       ///< the ADC clock only, the ADC ISR updates the DAC every FIS_SAMPLES_PER_POINT samples
+    FIS_TIMING_LAST_ONE
+} Fis_Timings;
+
+unsigned int fis_set_timing(unsigned int timing, unsigned int phase);
+unsigned int fis_get_timing(void);
+unsigned int fis_get_dac_phase(void);
+
+/**
+ * Selects the sparse per sample timestamps of the timing record
+ * @param every Samples between stamps, 0 = no stamps. At least
+ * samples_per_point, at most FIS_TIME_MAX_STAMPS stamps per sens_buff of the
+ * geometry and ADC mode of the run
+ */
+void fis_set_time_stamps(unsigned int every);
+
+/**
+ * Writes the timing record of the sens_buff waiting to be saved
+ * @param rec Output buffer of at least FIS_TIME_RECORD_LEN words
+ * @return Number of words written
+ */
+unsigned int fis_time_get_record(unsigned int *rec);
+
+/**
+ * ISRs of the expFis with latency and duration counters
+ */
+typedef enum{
+    FIS_ISR_T4=0,   ///< _T4Interrupt, DAC (FIS_TIMING_SEPARATE)
+    FIS_ISR_T5,     ///< _T5Interrupt, ADC soft trigger
+    FIS_ISR_ADC,    ///< _ADC1Interrupt, ADC hardware trigger modes
+    FIS_ISR_T3,     ///< _T3Interrupt, delayed conversion (FIS_TIMING_LOCKED soft trigger)
+    FIS_ISR_LAST_ONE
+} Fis_Isrs;
+
+#define FIS_ISR_RECORD_LEN (6 + FIS_ISR_BLOCK_LEN*FIS_ISR_LAST_ONE)
+
+/**
+ * Writes the ISR statistics of the last run
+ * @param rec Output buffer of at least FIS_ISR_RECORD_LEN words
+ * @return Number of words written
+ */
+unsigned int fis_isr_get_record(unsigned int *rec);
+void fis_isr_reset(void);
+void fis_isr_print(void);
 
 /**
  * Helper to iterate ONE TIME over one of the "_rounds_per_ADC_period"-times 
@@ -63,11 +315,14 @@ typedef enum{
 Fis_States fis_next_state_logic(Fis_States curr_state);
 Fis_States fis_current_state_control(Fis_States curr_state);
 void fis_run(unsigned int period);
+void fis_arm(unsigned int period);
 void fis_iterate_stop(void);
 void fis_ADC_config(void);
 void fis_Timer4_config(unsigned int period);
+void fis_Timer3_config(unsigned int period);
 void fis_Timer5_config(unsigned int period);
 void fis_payload_writeDAC(unsigned int arg);
+void fis_dac_spi_fast(BOOL on);
 void fis_iterate_pause(void);
 void fis_iterate_resume(void);
 void fis_payload_print_seed(unsigned int seed);
@@ -0,0 +1,95 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2013, Tomas Opazo Toro, tomas.opazo.t@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "fis_reduce.h"
+
+/*
+ * Reduces the n samples of one point, stride words apart
+ */
+static unsigned int fis_reduce_point(const unsigned int *src, unsigned int n,
+        unsigned int stride, unsigned int mode){
+    unsigned int v[FIS_SAMPLES_PER_POINT_MAX];
+    unsigned int i, j, x;
+    unsigned int sum = 0;   //n*1023 fits 16 bits
+
+    switch(mode){
+        case FIS_REDUCE_MEAN:
+            for(i = 0; i < n; i++){
+                sum += src[i*stride];
+            }
+            return (sum + n/2)/n;
+        case FIS_REDUCE_MEDIAN:
+            //insertion sort, n <= 16
+            for(i = 0; i < n; i++){
+                x = src[i*stride];
+                for(j = i; j > 0 && v[j-1] > x; j--){
+                    v[j] = v[j-1];
+                }
+                v[j] = x;
+            }
+            return (n & 1)? v[n/2] : (v[n/2-1] + v[n/2] + 1)/2;
+        default:    //FIS_REDUCE_SETTLED
+            return src[(n-1)*stride];
+    }
+}
+
+unsigned int fis_reduce_buff(const unsigned int *src, unsigned int len, unsigned int spp,
+        BOOL pairs, unsigned int mode, unsigned int *dst){
+    unsigned int i, k = 0;
+    if(spp == 0 || spp > FIS_SAMPLES_PER_POINT_MAX){ return 0; }
+    if(pairs){
+        for(i = 0; i + 2*spp <= len; i += 2*spp){
+            dst[k++] = fis_reduce_point(&src[i], spp, 2, mode);      //Vout
+            dst[k++] = fis_reduce_point(&src[i+1], spp, 2, mode);    //Vin
+        }
+    }
+    else{
+        for(i = 0; i + spp <= len; i += spp){
+            dst[k++] = fis_reduce_point(&src[i], spp, 1, mode);
+        }
+    }
+    return k;
+}
+
+unsigned int fis_reduce_settle(const unsigned int *src, unsigned int len, unsigned int spp,
+        BOOL pairs, unsigned int tol){
+    unsigned int stride = (pairs)? 2 : 1;
+    unsigned int n, half, m, i;
+    long ref_sum = 0, sum = 0, d;
+    int sign = 0;
+
+    if(spp == 0){ return 0; }
+    n = len/stride;
+    half = (n/spp/2)*spp;   //first sample of the second half, whole points
+    m = n - half;
+    if(half == 0){ return 0; }
+    for(i = half; i < n; i++){
+        ref_sum += src[i*stride];
+    }
+    //cumulative mean sum/(i+1) against ref_sum/m, without divisions
+    for(i = 0; i < half; i++){
+        sum += src[i*stride];
+        d = sum*(long)m - ref_sum*(long)(i+1);
+        if(d <= (long)tol*m*(i+1) && d >= -(long)tol*m*(i+1)){ break; }
+        if((d > 0 && sign < 0) || (d < 0 && sign > 0)){ break; }   //crossed the reference
+        sign = (d > 0)? 1 : -1;
+    }
+    return i/spp;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file  fis_reduce.h
+ * @copyright GNU Public License.
+ *
+ * Reduccion a bordo del sobremuestreo del expFis. Cada punto del DAC se
+ * muestrea samples_per_point veces; en vez de guardar todas las muestras se
+ * guarda una por punto (la media, la mediana o la ultima, ya asentada), lo
+ * que divide por samples_per_point el espacio en el repositorio de datos y el
+ * downlink. En FIS_ADC_HW_DUAL se reduce cada canal y se guarda un par
+ * (Vout, Vin) por punto.
+ *
+ * Las estadisticas e histogramas (fis_stats.h) se siguen calculando con todas
+ * las muestras. En tierra los datos reducidos se tratan como datos con una
+ * muestra por punto (pairSamplesWithPoints.m con oversamplingcoeff = 1).
+ *
+ * Tambien descarta el transiente del circuito al comienzo de cada sens_buff
+ * que sigue a una pausa (fis_set_settle), lo que antes se hacia en tierra con
+ * findSState.m. Con el descarte activo cada bloque guardado (FIS_OUTPUT_RAW o
+ * FIS_OUTPUT_COMP) va precedido de una palabra FIS_SETTLE_MARK | puntos
+ * descartados; las muestras de 10 bits y las cabeceras de fis_comp nunca
+ * toman ese valor (k = 13 no se usa). En tierra fisSettle.m separa las marcas
+ * de los datos RAW y fisRiceDecode.m las lee entre los bloques comprimidos.
+ */
+
+#ifndef _FIS_REDUCE_
+#define _FIS_REDUCE_
+
+#include "fis_payload.h"
+
+/**
+ * What is kept of the samples of a DAC point
+ */
+typedef enum{
+    FIS_REDUCE_NONE=0,  ///< every sample
+    FIS_REDUCE_MEAN,    ///< rounded mean
+    FIS_REDUCE_MEDIAN,  ///< median, mean of the two middle samples if even
+    FIS_REDUCE_SETTLED, ///< last sample of the point
+    FIS_REDUCE_LAST_ONE
+} Fis_Reductions;
+
+/**
+ * Reduces one sens_buff to one value per point
+ * @param src Samples (sens_buff), whole points
+ * @param len Number of words of src
+ * @param spp Samples per point, 1 to FIS_SAMPLES_PER_POINT_MAX
+ * @param pairs TRUE if src holds (Vout, Vin) pairs (FIS_ADC_HW_DUAL)
+ * @param mode One of Fis_Reductions, other than FIS_REDUCE_NONE
+ * @param dst Output buffer of at least len/spp words
+ * @return Number of words written into dst
+ */
+unsigned int fis_reduce_buff(const unsigned int *src, unsigned int len, unsigned int spp,
+        BOOL pairs, unsigned int mode, unsigned int *dst);
+
+//first word of each saved block while the transient rejection is on
+#define FIS_SETTLE_MARK (0xD000)
+//fis_set_settle: points found by fis_reduce_settle
+#define FIS_SETTLE_AUTO (0x0FFF)
+//fis_set_settle: default tolerance of FIS_SETTLE_AUTO, ADC counts (~6 mV)
+#define FIS_SETTLE_TOL_DEFAULT (2)
+
+/**
+ * Finds the end of the settling transient at the beginning of a sens_buff, as
+ * findSStateSimple.m does on ground: the first sample where the cumulative
+ * mean of Vout crosses the reference or gets within tol of it. The reference
+ * is the mean of the second half of the buffer, so at most half of it is
+ * reported as transient
+ * @param src Samples (sens_buff), whole points
+ * @param len Number of words of src
+ * @param spp Samples per point
+ * @param pairs TRUE if src holds (Vout, Vin) pairs (FIS_ADC_HW_DUAL)
+ * @param tol Tolerance, ADC counts
+ * @return Number of whole points before the steady state
+ */
+unsigned int fis_reduce_settle(const unsigned int *src, unsigned int len, unsigned int spp,
+        BOOL pairs, unsigned int tol);
+
+#endif
@@ -0,0 +1,308 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2013, Tomas Opazo Toro, tomas.opazo.t@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>   //sqrt
+#include "fis_stats.h"
+
+static FIS_Moments fis_stats_vout;  //ADC counts
+static FIS_Moments fis_stats_vin;   //DAC counts scaled to 10 bits
+static FIS_Moments fis_stats_power; //Vin*(Vin-Vout) in counts^2
+
+//histograms, default: 64 bins of 16 counts over the full ADC scale and
+//64 bins of 2^15 counts^2 centered at zero power
+static unsigned int fis_hist_nbins = FIS_HIST_MAX_BINS;
+static int fis_hist_vout_min = 0;
+static unsigned int fis_hist_vout_shift = 4;
+static long fis_hist_power_min = -((long)FIS_HIST_MAX_BINS << 14);
+static unsigned int fis_hist_power_shift = 15;
+static unsigned int fis_hist_vout[FIS_HIST_MAX_BINS];
+static unsigned int fis_hist_power[FIS_HIST_MAX_BINS];
+static unsigned int fis_hist_vout_out[2];     //below, above
+static unsigned int fis_hist_power_out[2];    //below, above
+
+static void fis_moments_reset(FIS_Moments *m){
+    m->n = 0;
+    m->min = 0x7FFFFFFFL;
+    m->max = -0x7FFFFFFFL;
+    m->offset = 0;
+    m->s1 = m->s2 = m->s3 = m->s4 = 0;
+}
+
+/*
+ * Adds one value to the running sums. With order 2 only s1 and s2 are
+ * updated (the power does not fit a 64 bits sum of x^4)
+ */
+static void fis_moments_add(FIS_Moments *m, long x, int order){
+    long d = x - m->offset;
+    long long d2 = (long long)d*d;  //the power reaches 2^20, its square does not fit a long
+
+    m->n++;
+    if(x < m->min){ m->min = x; }
+    if(x > m->max){ m->max = x; }
+    m->s1 += d;
+    m->s2 += d2;
+    if(order > 2){
+        m->s3 += d2*d;      //|d| < 2^10 => |d^3| < 2^30
+        m->s4 += d2*d2;
+    }
+}
+
+/*
+ * Computes the mean, standard deviation, skewness and kurtosis from the
+ * running sums. Only done once per run, so float is used here. The sums are
+ * centered at the mean of the first buffer, so e1 is small and the central
+ * moments do not cancel in the 24 bits mantissa
+ */
+static void fis_moments_compute(const FIS_Moments *m, float *mean,
+        float *std, float *skew, float *kurt){
+    float n, e1, e2, e3, e4, m2, m3, m4;
+
+    *mean = *std = *skew = *kurt = 0;
+    if(m->n == 0){ return; }
+
+    n = (float)m->n;
+    e1 = (float)m->s1/n;
+    e2 = (float)m->s2/n;
+    e3 = (float)m->s3/n;
+    e4 = (float)m->s4/n;
+    m2 = e2 - e1*e1;
+    m3 = e3 - 3*e1*e2 + 2*e1*e1*e1;
+    m4 = e4 - 4*e1*e3 + 6*e1*e1*e2 - 3*e1*e1*e1*e1;
+
+    *mean = e1 + m->offset;
+    if(m2 <= 0){ return; }
+    *std = sqrt(m2);
+    *skew = m3/(m2*(*std));
+    *kurt = m4/(m2*m2);
+}
+
+/*
+ * Rounds x*scale and saturates it to [min, max]
+ */
+static long fis_stats_fixed(float x, float scale, long min, long max){
+    x = x*scale;
+    x = (x < 0)? x - 0.5 : x + 0.5;
+    if(x < min){ return min; }
+    if(x > max){ return max; }
+    return (long)x;
+}
+
+/*
+ * Vout and Vin of the i-th sample of a sens_buff. Vin is the measured AN13
+ * when sens_buff holds pairs, or the DAC code scaled to 10 bits (16 bits DAC
+ * and 10 bits ADC, same 3.3V full scale). spp is the current samples_per_point
+ */
+static void fis_stats_sample(const unsigned int *vout, const unsigned int *dac,
+        unsigned int i, unsigned int spp, BOOL pairs, long *vo, long *vi){
+    if(pairs){
+        *vo = (long)vout[2*i];
+        *vi = (long)vout[2*i+1];
+    }
+    else{
+        *vo = (long)vout[i];
+        *vi = (long)(dac[i / spp] >> 6);
+    }
+}
+
+void fis_stats_reset(void){
+    fis_moments_reset(&fis_stats_vout);
+    fis_moments_reset(&fis_stats_vin);
+    fis_moments_reset(&fis_stats_power);
+}
+
+/*
+ * Centers the running sums at the mean of the first buffer of the run
+ */
+static void fis_stats_set_offsets(const unsigned int *vout, const unsigned int *dac,
+        unsigned int len, unsigned int spp, BOOL pairs){
+    unsigned int i;
+    long vo, vi;
+    long long svo = 0, svi = 0, sp = 0;
+    for(i = 0; i < len; i++){
+        fis_stats_sample(vout, dac, i, spp, pairs, &vo, &vi);
+        svo += vo;
+        svi += vi;
+        sp += vi*(vi - vo);
+    }
+    fis_stats_vout.offset = (long)(svo/len);
+    fis_stats_vin.offset = (long)(svi/len);
+    fis_stats_power.offset = (long)(sp/len);
+}
+
+void fis_stats_add_buff(const unsigned int *vout, const unsigned int *dac, unsigned int len, BOOL pairs){
+    unsigned int i, spp = fis_get_geometry()->samples_per_point;
+    long vo, vi;
+    if(pairs){ len = len/2; }
+    if(len == 0){ return; }
+    if(fis_stats_vout.n == 0){
+        fis_stats_set_offsets(vout, dac, len, spp, pairs);
+    }
+    for(i = 0; i < len; i++){
+        fis_stats_sample(vout, dac, i, spp, pairs, &vo, &vi);
+        fis_moments_add(&fis_stats_vout, vo, 4);
+        fis_moments_add(&fis_stats_vin, vi, 4);
+        fis_moments_add(&fis_stats_power, vi*(vi - vo), 2);
+    }
+}
+
+/*
+ * Writes min, max, mean*64, std*64, skew*4096 and kurt*4096 of a 10 bits variable
+ */
+static unsigned int fis_stats_put_10bits(unsigned int *rec, const FIS_Moments *m){
+    float mean, std, skew, kurt;
+    fis_moments_compute(m, &mean, &std, &skew, &kurt);
+    rec[0] = (m->n == 0)? 0 : (unsigned int)m->min;
+    rec[1] = (m->n == 0)? 0 : (unsigned int)m->max;
+    rec[2] = (unsigned int)fis_stats_fixed(mean, 64, 0, 0xFFFF);
+    rec[3] = (unsigned int)fis_stats_fixed(std, 64, 0, 0xFFFF);
+    rec[4] = (unsigned int)(int)fis_stats_fixed(skew, 4096, -0x7FFF, 0x7FFF);
+    rec[5] = (unsigned int)fis_stats_fixed(kurt, 4096, 0, 0xFFFF);
+    return 6;
+}
+
+static unsigned int fis_stats_put_long(unsigned int *rec, long value){
+    rec[0] = (unsigned int)(value>>0);
+    rec[1] = (unsigned int)(value>>16);
+    return 2;
+}
+
+unsigned int fis_stats_get_record(unsigned int *rec, unsigned int adcPeriod, unsigned int seed){
+    float mean, std, skew, kurt;
+    unsigned int i = 0;
+
+    rec[i++] = FIS_STATS_RECORD_ID;
+    rec[i++] = adcPeriod;
+    rec[i++] = seed;
+    i += fis_stats_put_long(&rec[i], (long)fis_stats_vout.n);
+    i += fis_stats_put_10bits(&rec[i], &fis_stats_vout);
+    i += fis_stats_put_10bits(&rec[i], &fis_stats_vin);
+
+    fis_moments_compute(&fis_stats_power, &mean, &std, &skew, &kurt);
+    i += fis_stats_put_long(&rec[i], (fis_stats_power.n == 0)? 0 : fis_stats_power.min);
+    i += fis_stats_put_long(&rec[i], (fis_stats_power.n == 0)? 0 : fis_stats_power.max);
+    i += fis_stats_put_long(&rec[i], fis_stats_fixed(mean, 16, -0x7FFFFFFFL, 0x7FFFFFFFL));
+    i += fis_stats_put_long(&rec[i], fis_stats_fixed(std, 16, 0, 0x7FFFFFFFL));
+
+    return i;
+}
+
+void fis_stats_print(void){
+    unsigned int rec[FIS_STATS_RECORD_LEN];
+    unsigned int i, len;
+    len = fis_stats_get_record(rec, fis_get_adcPeriod(), fis_get_seed());
+    printf("fis_stats record: ");
+    for(i = 0; i < len; i++){
+        printf("0x%04X,", rec[i]);
+    }
+    printf("\n");
+}
+
+BOOL fis_hist_config(unsigned int nbins, int vout_min, unsigned int vout_shift,
+        long power_min, unsigned int power_shift){
+    if(nbins == 0 || nbins > FIS_HIST_MAX_BINS || vout_shift > 10 || power_shift > 20){
+        #if FIS_CMD_VERBOSE > 0
+            printf("fis_hist_config: invalid config, nbins=%u, vout_shift=%u, power_shift=%u\n",
+                    nbins, vout_shift, power_shift);
+        #endif
+        return FALSE;
+    }
+    fis_hist_nbins = nbins;
+    fis_hist_vout_min = vout_min;
+    fis_hist_vout_shift = vout_shift;
+    fis_hist_power_min = power_min;
+    fis_hist_power_shift = power_shift;
+    fis_hist_reset();
+    return TRUE;
+}
+
+BOOL fis_hist_config_centered(unsigned int conf){
+    unsigned int nbins = conf & 0x00FF;
+    unsigned int vout_shift = (conf >> 8) & 0x000F;
+    unsigned int power_shift = (conf >> 12) & 0x000F;
+    int vout_min = (int)(FIS_STATS_OFFSET - (((long)nbins << vout_shift) >> 1));
+    long power_min = -(((long)nbins << power_shift) >> 1);
+    return fis_hist_config(nbins, vout_min, vout_shift, power_min, power_shift);
+}
+
+void fis_hist_reset(void){
+    unsigned int i;
+    for(i = 0; i < FIS_HIST_MAX_BINS; i++){
+        fis_hist_vout[i] = 0;
+        fis_hist_power[i] = 0;
+    }
+    fis_hist_vout_out[0] = fis_hist_vout_out[1] = 0;
+    fis_hist_power_out[0] = fis_hist_power_out[1] = 0;
+}
+
+static void fis_hist_count(unsigned int *count){
+    if(*count != 0xFFFF){ (*count)++; }
+}
+
+void fis_hist_add_buff(const unsigned int *vout, const unsigned int *dac, unsigned int len, BOOL pairs){
+    unsigned int i, bin, spp = fis_get_geometry()->samples_per_point;
+    int dvo;
+    long vo, vi, dp;
+    if(pairs){ len = len/2; }
+    for(i = 0; i < len; i++){
+        fis_stats_sample(vout, dac, i, spp, pairs, &vo, &vi);
+
+        dvo = (int)vo - fis_hist_vout_min;
+        if(dvo < 0){
+            fis_hist_count(&fis_hist_vout_out[0]);
+        }
+        else{
+            bin = (unsigned int)dvo >> fis_hist_vout_shift;
+            fis_hist_count((bin < fis_hist_nbins)? &fis_hist_vout[bin] : &fis_hist_vout_out[1]);
+        }
+
+        dp = vi*(vi - vo) - fis_hist_power_min;
+        if(dp < 0){
+            fis_hist_count(&fis_hist_power_out[0]);
+        }
+        else{
+            dp = dp >> fis_hist_power_shift;
+            fis_hist_count((dp < (long)fis_hist_nbins)? &fis_hist_power[(unsigned int)dp] : &fis_hist_power_out[1]);
+        }
+    }
+}
+
+unsigned int fis_hist_get_record(unsigned int *rec, unsigned int adcPeriod, unsigned int seed){
+    unsigned int i = 0, j;
+
+    rec[i++] = FIS_HIST_RECORD_ID;
+    rec[i++] = adcPeriod;
+    rec[i++] = seed;
+    rec[i++] = fis_hist_nbins;
+    rec[i++] = (unsigned int)fis_hist_vout_min;
+    rec[i++] = fis_hist_vout_shift;
+    i += fis_stats_put_long(&rec[i], fis_hist_power_min);
+    rec[i++] = fis_hist_power_shift;
+    rec[i++] = fis_hist_vout_out[0];
+    rec[i++] = fis_hist_vout_out[1];
+    rec[i++] = fis_hist_power_out[0];
+    rec[i++] = fis_hist_power_out[1];
+    for(j = 0; j < fis_hist_nbins; j++){
+        rec[i++] = fis_hist_vout[j];
+    }
+    for(j = 0; j < fis_hist_nbins; j++){
+        rec[i++] = fis_hist_power[j];
+    }
+
+    return i;
+}
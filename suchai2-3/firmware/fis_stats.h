@@ -0,0 +1,128 @@
+/**
+ * @file  fis_stats.h
+ * @copyright GNU Public License.
+ *
+ * Estadisticas incrementales del expFis. Se actualizan por cada sens_buff
+ * guardado, en punto fijo, para Vout (cuentas del ADC), Vin (cuentas del DAC
+ * escaladas a 10 bits, o AN13 medido en FIS_ADC_HW_DUAL) y la potencia
+ * inyectada Vin*(Vin-Vout). Al final de cada ejecucion (adcPeriod/seed) se
+ * genera un registro resumen que cabe en un frame de telemetria.
+ *
+ * Tambien construye los histogramas de Vout y de la potencia, acumulados en
+ * todos los buffers y rounds de una ejecucion, para obtener las PDF en tierra
+ * sin bajar cada muestra.
+ */
+
+#ifndef _FIS_STATS_
+#define _FIS_STATS_
+
+#include "fis_payload.h"
+
+//first word of a statistics summary record inside dat_pay_expFis
+#define FIS_STATS_RECORD_ID (0x57A7)
+//number of words of a statistics summary record
+#define FIS_STATS_RECORD_LEN (25)
+//mid scale of the 10 bits ADC, center of the default Vout histogram
+#define FIS_STATS_OFFSET (512L)
+
+//first word of a histogram record inside dat_pay_expFis
+#define FIS_HIST_RECORD_ID (0x4157)
+//max number of bins of each histogram
+#define FIS_HIST_MAX_BINS (64)
+//words before the bin counts in a histogram record
+#define FIS_HIST_HEADER_LEN (13)
+//max number of words of a histogram record
+#define FIS_HIST_RECORD_LEN ((FIS_HIST_HEADER_LEN) + 2*(FIS_HIST_MAX_BINS))
+
+/**
+ * Running sums of one variable
+ */
+typedef struct{
+    unsigned long n;    ///< number of samples
+    long min;           ///< smallest value
+    long max;           ///< largest value
+    long offset;        ///< mean of the first buffer, the sums are centered at it
+    long long s1;       ///< sum of (x-offset)
+    long long s2;       ///< sum of (x-offset)^2
+    long long s3;       ///< sum of (x-offset)^3 (Vin and Vout only)
+    long long s4;       ///< sum of (x-offset)^4 (Vin and Vout only)
+} FIS_Moments;
+
+void fis_stats_reset(void);
+
+/**
+ * Adds the samples of one sens_buff to the running sums
+ * @param vout ADC samples (sens_buff)
+ * @param dac DAC value of each point (samples_per_point samples per point, see fis_get_geometry)
+ * @param len Number of words in vout
+ * @param pairs TRUE if vout holds (Vout, Vin) pairs (FIS_ADC_HW_DUAL), then
+ * the measured Vin is used instead of dac
+ */
+void fis_stats_add_buff(const unsigned int *vout, const unsigned int *dac, unsigned int len, BOOL pairs);
+
+/**
+ * Fills the summary record of the current run
+ *
+ * | word  | content                                                |
+ * | 0     | FIS_STATS_RECORD_ID                                    |
+ * | 1, 2  | adcPeriod, seed                                        |
+ * | 3, 4  | number of samples (low, high)                          |
+ * | 5-10  | Vout: min, max, mean*64, std*64, skew*4096, kurt*4096   |
+ * | 11-16 | Vin: same as Vout                                      |
+ * | 17-24 | Power: min, max, mean*16, std*16 (low, high each)       |
+ *
+ * @param rec Buffer of FIS_STATS_RECORD_LEN words
+ * @return FIS_STATS_RECORD_LEN
+ */
+unsigned int fis_stats_get_record(unsigned int *rec, unsigned int adcPeriod, unsigned int seed);
+void fis_stats_print(void);
+
+/**
+ * Configures the histograms of Vout and of the injected power. Each bin is
+ * (1 << shift) counts wide so the binning is a subtraction and a shift
+ * @param nbins Number of bins, 1 to FIS_HIST_MAX_BINS
+ * @param vout_min Lower edge of the first Vout bin (ADC counts)
+ * @param vout_shift log2 of the Vout bin width
+ * @param power_min Lower edge of the first power bin (counts^2)
+ * @param power_shift log2 of the power bin width
+ * @return FALSE if a parameter is out of range (config unchanged)
+ */
+BOOL fis_hist_config(unsigned int nbins, int vout_min, unsigned int vout_shift,
+        long power_min, unsigned int power_shift);
+
+/**
+ * Configures histograms centered at mid scale (Vout) and zero (power)
+ * @param conf bits 0-7 number of bins, bits 8-11 Vout shift, bits 12-15 power shift
+ * @return FALSE if a parameter is out of range (config unchanged)
+ */
+BOOL fis_hist_config_centered(unsigned int conf);
+void fis_hist_reset(void);
+
+/**
+ * Adds the samples of one sens_buff to the histograms. Counts saturate at 0xFFFF
+ * @param vout ADC samples (sens_buff)
+ * @param dac DAC value of each point (samples_per_point samples per point, see fis_get_geometry)
+ * @param len Number of words in vout
+ * @param pairs TRUE if vout holds (Vout, Vin) pairs, see fis_stats_add_buff
+ */
+void fis_hist_add_buff(const unsigned int *vout, const unsigned int *dac, unsigned int len, BOOL pairs);
+
+/**
+ * Fills the histogram record of the current run
+ *
+ * | word  | content                                                |
+ * | 0     | FIS_HIST_RECORD_ID                                     |
+ * | 1, 2  | adcPeriod, seed                                        |
+ * | 3     | number of bins (nbins)                                 |
+ * | 4, 5  | Vout: first bin lower edge, log2 of bin width          |
+ * | 6-8   | Power: first bin lower edge (low, high), log2 of width |
+ * | 9, 10 | Vout: samples below, above the histogram               |
+ * | 11,12 | Power: samples below, above the histogram              |
+ * | 13-   | nbins Vout counts, then nbins power counts              |
+ *
+ * @param rec Buffer of FIS_HIST_RECORD_LEN words
+ * @return Number of words written (FIS_HIST_HEADER_LEN + 2*nbins)
+ */
+unsigned int fis_hist_get_record(unsigned int *rec, unsigned int adcPeriod, unsigned int seed);
+
+#endif
@@ -0,0 +1,207 @@
+/*                                 SUCHAI
+ *                      NANOSATELLITE FLIGHT SOFTWARE
+ *
+ *      Copyright 2013, Tomas Opazo Toro, tomas.opazo.t@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fis_wave.h"
+
+#define FIS_WAVE_MID (0x8000L)
+
+//gaussian quantiles, 8192*invNormCDF(0.5 + 0.5*i/128), the last one clamped
+static const int fis_wave_gauss[129] = {
+    0, 80, 160, 241, 321, 401, 482, 562, 642, 723,
+    803, 884, 965, 1046, 1127, 1208, 1289, 1370, 1451, 1533,
+    1615, 1697, 1779, 1861, 1943, 2026, 2109, 2192, 2275, 2358,
+    2442, 2526, 2610, 2695, 2780, 2865, 2950, 3036, 3122, 3208,
+    3295, 3382, 3470, 3558, 3646, 3735, 3824, 3914, 4004, 4095,
+    4186, 4277, 4370, 4462, 4556, 4650, 4744, 4839, 4935, 5032,
+    5129, 5227, 5326, 5425, 5525, 5627, 5729, 5831, 5935, 6040,
+    6146, 6253, 6360, 6469, 6580, 6691, 6804, 6917, 7033, 7149,
+    7268, 7387, 7508, 7631, 7756, 7883, 8011, 8141, 8274, 8409,
+    8546, 8685, 8827, 8972, 9119, 9270, 9424, 9581, 9742, 9906,
+    10075, 10248, 10426, 10609, 10797, 10991, 11192, 11399, 11615, 11838,
+    12071, 12313, 12568, 12834, 13115, 13413, 13729, 14068, 14432, 14827,
+    15259, 15740, 16281, 16904, 17645, 18565, 19805, 21791, 32767
+};
+
+//a quarter of a sine of amplitude 0x7000
+static const unsigned int fis_wave_sin_q[65] = {
+    0, 704, 1407, 2109, 2810, 3510, 4207, 4902, 5594, 6282,
+    6967, 7647, 8323, 8994, 9659, 10319, 10972, 11619, 12259, 12891,
+    13516, 14132, 14740, 15339, 15929, 16510, 17080, 17640, 18189, 18728,
+    19255, 19771, 20274, 20766, 21245, 21711, 22164, 22603, 23030, 23442,
+    23840, 24224, 24593, 24947, 25286, 25611, 25919, 26212, 26489, 26751,
+    26996, 27225, 27437, 27633, 27813, 27975, 28121, 28250, 28362, 28456,
+    28534, 28594, 28637, 28663, 28672
+};
+
+//phase increment (1/65536 cycles per point) of each FIS_WAVE_SINE step
+static const unsigned int fis_wave_sine_inc[16] = {
+    52, 76, 112, 164, 240, 353, 518, 760, 1116, 1638,
+    2405, 3530, 5181, 7605, 11162, 16384
+};
+
+//phase increment of each FIS_WAVE_CHIRP segment, 0.25*10^(-2.5*(127-j)/127) cycles per point
+static const unsigned int fis_wave_chirp_inc[128] = {
+    52, 54, 57, 59, 62, 65, 68, 71, 74, 78,
+    82, 85, 89, 93, 98, 102, 107, 112, 117, 123,
+    128, 134, 140, 147, 154, 161, 168, 176, 184, 193,
+    202, 211, 221, 231, 242, 253, 265, 277, 290, 303,
+    318, 332, 348, 364, 381, 398, 417, 436, 456, 478,
+    500, 523, 547, 572, 599, 627, 656, 686, 718, 751,
+    786, 823, 861, 901, 942, 986, 1032, 1080, 1130, 1182,
+    1237, 1294, 1354, 1417, 1483, 1552, 1624, 1699, 1778, 1860,
+    1946, 2037, 2131, 2230, 2333, 2441, 2555, 2673, 2797, 2927,
+    3062, 3204, 3353, 3509, 3671, 3841, 4020, 4206, 4401, 4605,
+    4819, 5042, 5276, 5521, 5776, 6044, 6325, 6618, 6925, 7246,
+    7582, 7933, 8301, 8686, 9089, 9510, 9951, 10413, 10896, 11401,
+    11930, 12483, 13062, 13667, 14301, 14964, 15658, 16384
+};
+
+//phase at the beginning of each FIS_WAVE_CHIRP segment, so the phase is continuous
+static unsigned int fis_wave_chirp_phase[FIS_WAVE_CHIRP_SEGS];
+
+//waveform length (fis_wave_config)
+static unsigned int fis_wave_points = FIS_SIGNAL_POINTS;
+static unsigned int fis_wave_sine_step = FIS_SIGNAL_POINTS/FIS_WAVE_SINE_STEPS;
+static unsigned int fis_wave_chirp_seg = FIS_SIGNAL_POINTS/FIS_WAVE_CHIRP_SEGS;
+
+//last FIS_WAVE_MLS state, to step instead of jump on consecutive points. Shared
+//by fis_dac_table_fill and the DAC ISR, which only call it at FIS_ISR_IPL
+static BOOL fis_wave_mls_valid = FALSE;
+static unsigned int fis_wave_mls_seed;
+static unsigned long fis_wave_mls_n;
+static unsigned int fis_wave_mls_state;
+
+/*
+ * Point of the current waveform, the burn-in before point 0 (negative n)
+ * plays the end of the previous waveform
+ */
+static unsigned int fis_wave_point(unsigned long n){
+    long k = (long)n % (long)fis_wave_points;
+    if(k < 0){ k += fis_wave_points; }
+    return (unsigned int)k;
+}
+
+/*
+ * Phase at the beginning of each chirp segment, sum of the increments of the
+ * segments before it (mod 2^16)
+ */
+static void fis_wave_chirp_init(void){
+    unsigned int i;
+    fis_wave_chirp_phase[0] = 0;
+    for(i = 1; i < FIS_WAVE_CHIRP_SEGS; i++){
+        fis_wave_chirp_phase[i] = fis_wave_chirp_phase[i-1] + fis_wave_chirp_seg*fis_wave_chirp_inc[i-1];
+    }
+}
+
+void fis_wave_config(unsigned int points){
+    fis_wave_points = points;
+    fis_wave_sine_step = points/FIS_WAVE_SINE_STEPS;
+    fis_wave_chirp_seg = points/FIS_WAVE_CHIRP_SEGS;
+    fis_wave_chirp_init();   //not in fis_wave_code, which also runs in the DAC ISR
+}
+
+
+static unsigned int fis_wave_sin(unsigned int phase){
+    unsigned int i = (phase >> 8) & 0x3F;
+    switch((phase >> 14) & 0x3){
+        case 0: return (unsigned int)(FIS_WAVE_MID + fis_wave_sin_q[i]);
+        case 1: return (unsigned int)(FIS_WAVE_MID + fis_wave_sin_q[64-i]);
+        case 2: return (unsigned int)(FIS_WAVE_MID - fis_wave_sin_q[i]);
+        default: return (unsigned int)(FIS_WAVE_MID - fis_wave_sin_q[64-i]);
+    }
+}
+
+static unsigned int fis_wave_gaussian(unsigned int seed, unsigned long n){
+    unsigned int r = fis_rng(seed, n);
+    unsigned int i = (r >> 8) & 0x7F;
+    long v = fis_wave_gauss[i] + ((((long)fis_wave_gauss[i+1] - fis_wave_gauss[i]) * (r & 0xFF)) >> 8);
+    return (unsigned int)((r & 0x8000)? FIS_WAVE_MID - v : FIS_WAVE_MID + v);
+}
+
+/*
+ * Galois LFSR of x^15 + x^14 + 1, multiplies the state by x
+ */
+static unsigned int fis_wave_mls_step(unsigned int s){
+    s = s << 1;
+    if(s & 0x8000){ s ^= 0xC001; }
+    return s;
+}
+
+//a*b mod (x^15 + x^14 + 1) over GF(2)
+static unsigned int fis_wave_mls_mul(unsigned int a, unsigned int b){
+    unsigned int r = 0;
+    int i;
+    for(i = 14; i >= 0; i--){
+        r = fis_wave_mls_step(r);
+        if(b & (1U << i)){ r ^= a; }
+    }
+    return r;
+}
+
+/*
+ * State after n steps is x^n * s0, so any point is reached in O(log n)
+ * multiplications
+ */
+static unsigned int fis_wave_mls_jump(unsigned int seed, unsigned long n){
+    long m = (long)n % FIS_WAVE_MLS_PERIOD;
+    unsigned int p = 1, x = 0x0002;
+    if(m < 0){ m += FIS_WAVE_MLS_PERIOD; }
+    while(m > 0){
+        if(m & 1){ p = fis_wave_mls_mul(p, x); }
+        x = fis_wave_mls_mul(x, x);
+        m >>= 1;
+    }
+    return fis_wave_mls_mul(p, (unsigned int)(seed % (unsigned int)FIS_WAVE_MLS_PERIOD) + 1);
+}
+
+static unsigned int fis_wave_mls(unsigned int seed, unsigned long n){
+    if(fis_wave_mls_valid && seed == fis_wave_mls_seed && n == fis_wave_mls_n+1){
+        fis_wave_mls_state = fis_wave_mls_step(fis_wave_mls_state);
+    }
+    else{
+        fis_wave_mls_state = fis_wave_mls_jump(seed, n);
+    }
+    fis_wave_mls_valid = TRUE;
+    fis_wave_mls_seed = seed;
+    fis_wave_mls_n = n;
+    return (fis_wave_mls_state & 0x4000)? 0xE000 : 0x2000;
+}
+
+unsigned int fis_wave_code(unsigned int wave, unsigned int seed, unsigned long n){
+    unsigned int k, i;
+    switch(wave){
+        case FIS_WAVE_GAUSS:
+            return fis_wave_gaussian(seed, n);
+        case FIS_WAVE_MLS:
+            return fis_wave_mls(seed, n);
+        case FIS_WAVE_SINE:
+            k = fis_wave_point(n);
+            i = k / fis_wave_sine_step;
+            if(i >= FIS_WAVE_SINE_STEPS){ i = FIS_WAVE_SINE_STEPS-1; }  //signal_points not a multiple of 16
+            return fis_wave_sin((k - i*fis_wave_sine_step) * fis_wave_sine_inc[i]);
+        case FIS_WAVE_CHIRP:
+            k = fis_wave_point(n);
+            i = k / fis_wave_chirp_seg;
+            if(i >= FIS_WAVE_CHIRP_SEGS){ i = FIS_WAVE_CHIRP_SEGS-1; }
+            return fis_wave_sin(fis_wave_chirp_phase[i]
+                    + (k - i*fis_wave_chirp_seg) * fis_wave_chirp_inc[i]);
+        default:
+            return fis_rng(seed, n);
+    }
+}
@@ -0,0 +1,52 @@
+/**
+ * @file  fis_wave.h
+ * @copyright GNU Public License.
+ *
+ * Generadores de estimulo para el DAC del expFis. Cada modo es una funcion
+ * pura de (seed, n), con n el contador de puntos de fis_rng(), asi que todos
+ * permiten saltar a cualquier punto (reanudar, burn-in) y se pueden
+ * reproducir en tierra. Se selecciona con pay_set_waveform_expFis.
+ */
+
+#ifndef _FIS_WAVE_
+#define _FIS_WAVE_
+
+#include "fis_payload.h"
+
+//frequencies of FIS_WAVE_SINE, of signal_points/16 points each
+#define FIS_WAVE_SINE_STEPS (16)
+//segments of constant frequency of FIS_WAVE_CHIRP, of signal_points/128 points each
+#define FIS_WAVE_CHIRP_SEGS (128)
+//period of the FIS_WAVE_MLS sequence (x^15 + x^14 + 1)
+#define FIS_WAVE_MLS_PERIOD (32767L)
+
+/**
+ * Stimulus of the DAC
+ */
+typedef enum{
+    FIS_WAVE_UNIFORM=0,  ///< uniform noise, fis_rng()
+    FIS_WAVE_GAUSS,      ///< gaussian noise, sigma = 8192 codes, inverse CDF table
+    FIS_WAVE_MLS,        ///< maximum length PRBS15, one bit per point (0x2000/0xE000)
+    FIS_WAVE_SINE,       ///< 16 log spaced sine steps, 1/1260 to 1/4 cycles per point
+    FIS_WAVE_CHIRP,      ///< log chirp over the same band, 128 segments per waveform
+    FIS_WAVE_LAST_ONE
+} Fis_Waveforms;
+
+/**
+ * DAC code of one point of the stimulus
+ * @param wave One of Fis_Waveforms
+ * @param seed Seed of the experiment (noise and MLS modes only)
+ * @param n Point counter, as in fis_rng()
+ * @return 16 bits DAC code
+ */
+unsigned int fis_wave_code(unsigned int wave, unsigned int seed, unsigned long n);
+
+/**
+ * Sets the length of the waveform (FIS_Geometry.signal_points) the periodic
+ * stimuli (sine and chirp) are spread over. It also computes the chirp
+ * segment phases, so call it from task context
+ * @param points Points of a waveform, at least FIS_SIGNAL_POINTS_MIN
+ */
+void fis_wave_config(unsigned int points);
+
+#endif